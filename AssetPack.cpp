@@ -0,0 +1,318 @@
+#include "AssetPack.h"
+#include "Compression.h"
+#include "Jobs.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+
+namespace
+{
+	const uint64_t BLOB_ALIGNMENT = 64;
+
+	// Compressed entries have to save at least this fraction of their size
+	const size_t MIN_SAVING_DIVISOR = 8;
+
+	MappedFile packFile;
+	const AssetPackEntry* entries = nullptr;
+	const char* names = nullptr;
+	uint32_t packEntryCount = 0;
+
+	inline uint64_t alignUp(uint64_t value)
+	{
+		return (value + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+	}
+
+	// "./3D\\a/../b.obj" and "3D/b.obj" name the same entry
+	std::string normalizePath(std::string path)
+	{
+		std::replace(path.begin(), path.end(), '\\', '/');
+		return std::filesystem::path(path).lexically_normal().generic_string();
+	}
+
+	std::string_view entryName(const AssetPackEntry& entry)
+	{
+		return std::string_view(names + entry.nameOffset, entry.nameLength);
+	}
+
+	// Binary search of the sorted index
+	const AssetPackEntry* findEntry(const std::string& path)
+	{
+		if (packEntryCount == 0)
+			return nullptr;
+
+		std::string name = normalizePath(path);
+		const AssetPackEntry* end = entries + packEntryCount;
+		const AssetPackEntry* found = std::lower_bound(entries, end, std::string_view(name), [](const AssetPackEntry& entry, std::string_view key)
+			{ return entryName(entry) < key; });
+
+		return found != end && entryName(*found) == name ? found : nullptr;
+	}
+
+	struct PackInput
+	{
+		std::string name;
+		std::string path;
+		std::vector<unsigned char> blob;
+		uint64_t size;
+		uint32_t flags;
+		bool readable;
+	};
+}
+
+bool AssetFile::open(const std::string& path)
+{
+	close();
+
+	const AssetPackEntry* entry = findEntry(path);
+
+	if (entry == nullptr)
+	{
+		if (!this->loose.open(path))
+			return false;
+
+		this->bytes = this->loose.data();
+		this->length = this->loose.size();
+		return true;
+	}
+
+	const unsigned char* blob = packFile.data() + entry->offset;
+
+	if (entry->flags & PACK_ENTRY_LZ4)
+	{
+		this->inflated.resize((size_t)entry->size);
+
+		if (!lz4Decompress(blob, (size_t)entry->storedSize, this->inflated.data(), this->inflated.size()))
+		{
+			std::vector<unsigned char>().swap(this->inflated);
+			return false;
+		}
+
+		blob = this->inflated.data();
+	}
+
+	// Zero-length entries still count as open
+	static const unsigned char empty = 0;
+	this->bytes = entry->size == 0 ? &empty : blob;
+	this->length = (size_t)entry->size;
+	return true;
+}
+
+void AssetFile::close()
+{
+	this->loose.close();
+	std::vector<unsigned char>().swap(this->inflated);
+	this->bytes = nullptr;
+	this->length = 0;
+}
+
+uint64_t hashAsset(const std::string& path)
+{
+	AssetFile file;
+
+	if (!file.open(path))
+		return 0;
+
+	return hashBytes(file.data(), file.size());
+}
+
+bool AssetPack::mount(const std::string& path)
+{
+	unmount();
+
+	if (!packFile.open(path) || packFile.size() < sizeof(AssetPackHeader))
+	{
+		packFile.close();
+		return false;
+	}
+
+	const AssetPackHeader* header = (const AssetPackHeader*)packFile.data();
+	uint64_t namesOffset = sizeof(AssetPackHeader) + (uint64_t)header->entryCount * sizeof(AssetPackEntry);
+
+	bool valid = header->magic == ASSET_PACK_MAGIC &&
+		header->version == ASSET_PACK_VERSION &&
+		namesOffset + header->nameBytes <= packFile.size();
+
+	const AssetPackEntry* candidates = (const AssetPackEntry*)(packFile.data() + sizeof(AssetPackHeader));
+
+	for (uint32_t i = 0; valid && i < header->entryCount; i++)
+	{
+		const AssetPackEntry& entry = candidates[i];
+
+		valid = (uint64_t)entry.nameOffset + entry.nameLength <= header->nameBytes &&
+			entry.offset <= packFile.size() &&
+			entry.storedSize <= packFile.size() - entry.offset &&
+			((entry.flags & PACK_ENTRY_LZ4) || entry.storedSize == entry.size);
+	}
+
+	if (!valid)
+	{
+		packFile.close();
+		return false;
+	}
+
+	entries = candidates;
+	names = (const char*)packFile.data() + namesOffset;
+	packEntryCount = header->entryCount;
+	return true;
+}
+
+void AssetPack::unmount()
+{
+	entries = nullptr;
+	names = nullptr;
+	packEntryCount = 0;
+	packFile.close();
+}
+
+size_t AssetPack::entryCount()
+{
+	return packEntryCount;
+}
+
+bool AssetPack::contains(const std::string& path)
+{
+	return findEntry(path) != nullptr;
+}
+
+bool AssetPack::build(const std::string& path, const std::vector<std::string>& inputs, bool compress, std::string& error)
+{
+	namespace fs = std::filesystem;
+
+	// ---------------------------------------------------
+	// COLLECTING FILES
+	std::vector<PackInput> files;
+	std::error_code code;
+
+	auto add = [&](const fs::path& file)
+	{
+		if (file.extension() != ".mesh" && file.extension() != ".tex")
+			files.push_back({normalizePath(file.generic_string()), file.string(), {}, 0, 0, false});
+	};
+
+	for (const std::string& input : inputs)
+	{
+		if (fs::is_directory(input, code))
+		{
+			for (const fs::directory_entry& item : fs::recursive_directory_iterator(input, code))
+			{
+				if (item.is_regular_file(code))
+					add(item.path());
+			}
+		}
+		else if (fs::is_regular_file(input, code))
+			add(input);
+		else
+		{
+			error = "Cannot find [" + input + "]";
+			return false;
+		}
+	}
+
+	std::sort(files.begin(), files.end(), [](const PackInput& a, const PackInput& b)
+		{ return a.name < b.name; });
+
+	files.erase(std::unique(files.begin(), files.end(), [](const PackInput& a, const PackInput& b)
+		{ return a.name == b.name; }), files.end());
+
+	// ---------------------------------------------------
+	// READING AND COMPRESSING
+	parallelFor(files.size(), [&](size_t i)
+		{
+			PackInput& file = files[i];
+			MappedFile source;
+			std::error_code sizeCode;
+
+			// Empty files cannot be mapped, they are packed as empty entries
+			file.readable = source.open(file.path) || fs::file_size(file.path, sizeCode) == 0;
+
+			if (!source.isOpen())
+				return;
+
+			file.size = source.size();
+
+			if (compress)
+			{
+				lz4Compress(source.data(), source.size(), file.blob);
+
+				if (file.blob.size() <= source.size() - source.size() / MIN_SAVING_DIVISOR)
+				{
+					file.flags = PACK_ENTRY_LZ4;
+					return;
+				}
+			}
+
+			file.blob.assign(source.data(), source.data() + source.size());
+		});
+
+	for (const PackInput& file : files)
+	{
+		if (!file.readable)
+		{
+			error = "Cannot read [" + file.path + "]";
+			return false;
+		}
+	}
+
+	// ---------------------------------------------------
+	// INDEX
+	AssetPackHeader header = {ASSET_PACK_MAGIC, ASSET_PACK_VERSION, (uint32_t)files.size(), 0};
+	std::vector<AssetPackEntry> index(files.size());
+	std::string nameTable;
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		index[i].nameOffset = (uint32_t)nameTable.size();
+		index[i].nameLength = (uint32_t)files[i].name.size();
+		index[i].storedSize = files[i].blob.size();
+		index[i].size = files[i].size;
+		index[i].flags = files[i].flags;
+		nameTable += files[i].name;
+	}
+
+	header.nameBytes = (uint32_t)nameTable.size();
+
+	uint64_t offset = alignUp(sizeof(AssetPackHeader) + index.size() * sizeof(AssetPackEntry) + nameTable.size());
+
+	for (AssetPackEntry& entry : index)
+	{
+		entry.offset = offset;
+		offset = alignUp(offset + entry.storedSize);
+	}
+
+	// ---------------------------------------------------
+	// WRITING
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		static const char zeros[BLOB_ALIGNMENT] = {};
+
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)index.data(), index.size() * sizeof(AssetPackEntry));
+		out.write(nameTable.data(), nameTable.size());
+
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			out.write(zeros, index[i].offset - (uint64_t)out.tellp());
+			out.write((const char*)files[i].blob.data(), files[i].blob.size());
+		}
+
+		if (!out)
+		{
+			error = "Cannot write [" + temporary + "]";
+			return false;
+		}
+	}
+
+	fs::rename(temporary, path, code);
+
+	if (code)
+	{
+		error = "Cannot replace [" + path + "]: " + code.message();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const uint32_t ASSET_PACK_MAGIC = 0x4B505847; // "GXPK"
+const uint32_t ASSET_PACK_VERSION = 1;
+
+// Entry flags
+const uint32_t PACK_ENTRY_LZ4 = 1;
+
+/// <summary>
+/// On-disk header of an asset pack (.pack).
+/// Layout: header | entries sorted by path | path names | blobs, blobs 64-byte aligned.
+/// </summary>
+struct AssetPackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t nameBytes;
+};
+
+struct AssetPackEntry
+{
+	uint64_t offset;
+	uint64_t storedSize; // compressed size, or size when stored as is
+	uint64_t size;
+	uint32_t nameOffset; // into the path names, which follow the entries
+	uint32_t nameLength;
+	uint32_t flags;
+	uint32_t padding;
+};
+
+/// <summary>
+/// Read-only contents of one asset, from the mounted pack when it holds the
+/// path and from the loose file otherwise. Stored pack entries point straight
+/// into the pack's mapping, compressed ones are inflated into memory.
+/// </summary>
+class AssetFile
+{
+private:
+	MappedFile loose;
+	std::vector<unsigned char> inflated;
+	const unsigned char* bytes;
+	size_t length;
+
+public:
+	inline AssetFile() : bytes(nullptr), length(0) {}
+
+	AssetFile(const AssetFile&) = delete;
+	AssetFile& operator=(const AssetFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	inline bool isOpen() const
+	{
+		return this->bytes != nullptr;
+	}
+
+	inline const unsigned char* data() const
+	{
+		return this->bytes;
+	}
+
+	inline size_t size() const
+	{
+		return this->length;
+	}
+};
+
+// Hash of an asset's contents (see hashFile), 0 when it cannot be read
+uint64_t hashAsset(const std::string& path);
+
+/// <summary>
+/// The single pack every AssetFile looks into before the loose files.
+/// Mount it before any loading starts; unmount only once no AssetFile is open.
+/// </summary>
+class AssetPack
+{
+public:
+	// Maps the pack and checks its index, fails if it is missing or malformed
+	static bool mount(const std::string& path);
+	static void unmount();
+
+	// Number of entries in the mounted pack, 0 when none is mounted
+	static size_t entryCount();
+
+	// True when the mounted pack holds path
+	static bool contains(const std::string& path);
+
+	/// <summary>
+	/// Packs files, and everything below directories, into a new pack.
+	/// Entries are LZ4 compressed when compress is set and it saves enough.
+	/// Mesh and texture caches are skipped (they are rebuilt locally). The pack is written
+	/// next to path and renamed over it, so readers never see half a pack.
+	/// </summary>
+	static bool build(const std::string& path, const std::vector<std::string>& inputs, bool compress, std::string& error);
+};
@@ -0,0 +1,99 @@
+#include "AssetRegistry.h"
+
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+	std::mutex registryMutex;
+	std::unordered_map<std::string, std::weak_ptr<MeshAsset>> meshes;
+	std::unordered_map<std::string, std::weak_ptr<const TextureAsset>> textures;
+}
+
+TextureAsset::~TextureAsset()
+{
+	if (this->id != 0)
+		glDeleteTextures(1, &this->id);
+}
+
+MeshAsset::~MeshAsset()
+{
+	if (this->VAO != 0)
+		glDeleteVertexArrays(1, &this->VAO);
+
+	if (this->VBO != 0)
+		glDeleteBuffers(1, &this->VBO);
+
+	if (this->EBO != 0)
+		glDeleteBuffers(1, &this->EBO);
+}
+
+std::string AssetRegistry::canonicalPath(const std::string& path)
+{
+	std::error_code error;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+
+	return error ? path : canonical.generic_string();
+}
+
+MeshHandle AssetRegistry::addMesh(const std::string& key, const MeshHandle& mesh)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	std::weak_ptr<MeshAsset>& entry = meshes[key];
+	MeshHandle existing = entry.lock();
+
+	if (existing)
+		return existing;
+
+	entry = mesh;
+	return mesh;
+}
+
+TextureHandle AssetRegistry::findTexture(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	auto found = textures.find(key);
+
+	return found == textures.end() ? nullptr : found->second.lock();
+}
+
+TextureHandle AssetRegistry::acquireTexture(const std::string& key, const std::function<GLuint()>& create,
+	bool* created)
+{
+	if (created)
+		*created = false;
+
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		auto found = textures.find(key);
+
+		if (found != textures.end())
+		{
+			if (TextureHandle texture = found->second.lock())
+				return texture;
+		}
+	}
+
+	// Decoding and uploading happen outside the lock, GL calls stay on one thread anyway
+	std::shared_ptr<TextureAsset> texture = std::make_shared<TextureAsset>();
+	texture->id = create();
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::weak_ptr<const TextureAsset>& entry = textures[key];
+
+	// Someone else published while this one was being made: theirs wins,
+	// this one's GL name goes when texture goes out of scope
+	if (TextureHandle existing = entry.lock())
+		return existing;
+
+	entry = texture;
+
+	if (created)
+		*created = true;
+
+	return texture;
+}
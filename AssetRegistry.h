@@ -0,0 +1,93 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "MeshCache.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// A GL texture owned by every handle to it, deleted with the last one.
+/// </summary>
+struct TextureAsset
+{
+	GLuint id = 0;
+
+	TextureAsset() = default;
+	TextureAsset(const TextureAsset&) = delete;
+	TextureAsset& operator=(const TextureAsset&) = delete;
+	~TextureAsset();
+};
+
+typedef std::shared_ptr<const TextureAsset> TextureHandle;
+
+/// <summary>
+/// GPU buffers and draw tables of one model file, shared by every
+/// ModelClass loaded from it and deleted with the last of them.
+/// </summary>
+struct MeshAsset
+{
+	GLuint VAO = 0, VBO = 0, EBO = 0;
+
+	GLsizei vertexStride = 0;
+	// Vertices in the quantized layout, positions normalized across the bounds
+	bool packedVertices = false;
+	GLsizei vertexCount = 0;
+	GLsizei indexCount = 0;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	// Published by the loading thread as soon as the bounds are final
+	std::atomic<bool> boundsReady{false};
+
+	// Index ranges per shape and material, packed in material order.
+	// Holds every detail level back to back, lods picks the run to draw.
+	std::vector<SubMesh> submeshes;
+	std::vector<MeshLod> lods;
+	// Clusters of every submesh, in index buffer order (empty without meshlet culling)
+	std::vector<Meshlet> meshlets;
+	// Diffuse texture path per material, empty when it has none
+	std::vector<std::string> materialTexturePaths;
+	// Texture per material, null falls back to the model's base texture
+	std::vector<TextureHandle> materialTextures;
+
+	MeshAsset() = default;
+	MeshAsset(const MeshAsset&) = delete;
+	MeshAsset& operator=(const MeshAsset&) = delete;
+	~MeshAsset();
+};
+
+typedef std::shared_ptr<MeshAsset> MeshHandle;
+
+/// <summary>
+/// Hands out reference-counted meshes and textures keyed by canonical file
+/// path, so loading the same file twice returns the resources already made.
+/// The registry only keeps weak references: an asset is freed as soon as
+/// its last handle goes away. Safe to use from the worker threads.
+/// </summary>
+class AssetRegistry
+{
+public:
+	// Absolute, normalized form of a path, so "a/../b.obj" and "b.obj" match
+	static std::string canonicalPath(const std::string& path);
+
+	// Registers mesh under key, unless another live one got there first,
+	// in which case that one is returned instead
+	static MeshHandle addMesh(const std::string& key, const MeshHandle& mesh);
+
+	// Live texture registered under key, null when there is none
+	static TextureHandle findTexture(const std::string& key);
+
+	/// <summary>
+	/// Live texture registered under key, or a new one whose GL name comes
+	/// from create (called without the registry lock, on the GL thread).
+	/// When another caller registers the key while create runs, its texture
+	/// is returned and the new one is freed. created tells whether the
+	/// texture returned is the one create made.
+	/// </summary>
+	static TextureHandle acquireTexture(const std::string& key, const std::function<GLuint()>& create,
+		bool* created = nullptr);
+};
@@ -0,0 +1,309 @@
+#include "BatchReader.h"
+#include "AssetPack.h"
+#include "Jobs.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define USE_IO_URING
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Pack entries and the fallback path
+	void readBlocking(FileRead& read)
+	{
+		AssetFile file;
+		read.ok = file.open(read.path);
+
+		if (read.ok)
+			read.bytes.assign(file.data(), file.data() + file.size());
+	}
+
+#ifdef USE_IO_URING
+	const unsigned MAX_RING_ENTRIES = 64;
+
+	// A single read is capped well below the 32-bit length of a submission
+	const size_t MAX_READ_BYTES = (size_t)1 << 30;
+
+	/// <summary>
+	/// Bare io_uring (no liburing): submission and completion rings mapped
+	/// from the kernel, driven through the two raw system calls.
+	/// </summary>
+	class Ring
+	{
+	private:
+		int fd = -1;
+		void* sqRing = MAP_FAILED;
+		void* cqRing = MAP_FAILED;
+		size_t sqRingSize = 0, cqRingSize = 0, sqeSize = 0;
+		io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+
+		unsigned *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+		unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+		io_uring_cqe* cqes = nullptr;
+		unsigned queued = 0;
+
+	public:
+		unsigned entries = 0;
+
+		~Ring()
+		{
+			if (this->sqes != MAP_FAILED)
+				munmap(this->sqes, this->sqeSize);
+			if (this->cqRing != MAP_FAILED && this->cqRing != this->sqRing)
+				munmap(this->cqRing, this->cqRingSize);
+			if (this->sqRing != MAP_FAILED)
+				munmap(this->sqRing, this->sqRingSize);
+			if (this->fd >= 0)
+				close(this->fd);
+		}
+
+		// False when the kernel has no io_uring or it is disabled
+		bool open(unsigned requested)
+		{
+			io_uring_params params;
+			std::memset(&params, 0, sizeof(params));
+
+			this->fd = (int)syscall(__NR_io_uring_setup, requested, &params);
+
+			if (this->fd < 0)
+				return false;
+
+			this->entries = params.sq_entries;
+			this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+			// Newer kernels share one mapping between both rings
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+				this->sqRingSize = this->cqRingSize = std::max(this->sqRingSize, this->cqRingSize);
+
+			this->sqRing = mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+
+			if (this->sqRing == MAP_FAILED)
+				return false;
+
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+				this->cqRing = this->sqRing;
+			else
+				this->cqRing = mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING);
+
+			if (this->cqRing == MAP_FAILED)
+				return false;
+
+			this->sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+			this->sqes = (io_uring_sqe*)mmap(nullptr, this->sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES);
+
+			if (this->sqes == MAP_FAILED)
+				return false;
+
+			unsigned char* sq = (unsigned char*)this->sqRing;
+			unsigned char* cq = (unsigned char*)this->cqRing;
+
+			this->sqTail = (unsigned*)(sq + params.sq_off.tail);
+			this->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+			this->sqArray = (unsigned*)(sq + params.sq_off.array);
+			this->cqHead = (unsigned*)(cq + params.cq_off.head);
+			this->cqTail = (unsigned*)(cq + params.cq_off.tail);
+			this->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+			this->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+			return true;
+		}
+
+		// Queues a read, at most entries of them between two submit() calls
+		void read(int file, void* buffer, unsigned length, uint64_t offset, uint64_t tag)
+		{
+			unsigned tail = *this->sqTail + this->queued;
+			unsigned slot = tail & *this->sqMask;
+			io_uring_sqe& sqe = this->sqes[slot];
+
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = IORING_OP_READ;
+			sqe.fd = file;
+			sqe.addr = (uint64_t)(uintptr_t)buffer;
+			sqe.len = length;
+			sqe.off = offset;
+			sqe.user_data = tag;
+
+			this->sqArray[slot] = slot;
+			this->queued++;
+		}
+
+		// Hands the queued reads to the kernel and waits for at least one completion
+		bool submit()
+		{
+			__atomic_store_n(this->sqTail, *this->sqTail + this->queued, __ATOMIC_RELEASE);
+
+			unsigned toSubmit = this->queued;
+			this->queued = 0;
+
+			while (true)
+			{
+				long submitted = syscall(__NR_io_uring_enter, this->fd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+				if (submitted >= 0)
+					return true;
+
+				if (errno != EINTR)
+					return false;
+
+				// Retrying only the wait, the entries were taken before the interruption
+				toSubmit = 0;
+			}
+		}
+
+		// Calls done(tag, result) for every finished read
+		template <typename Done>
+		void reap(Done done)
+		{
+			unsigned head = *this->cqHead;
+			unsigned tail = __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE);
+
+			for (; head != tail; head++)
+			{
+				const io_uring_cqe& cqe = this->cqes[head & *this->cqMask];
+				done(cqe.user_data, cqe.res);
+			}
+
+			__atomic_store_n(this->cqHead, head, __ATOMIC_RELEASE);
+		}
+	};
+
+	struct LooseRead
+	{
+		FileRead* read;
+		int fd;
+		size_t offset;
+	};
+
+	// False when io_uring is unavailable, nothing has been read then
+	bool readUring(std::vector<FileRead*>& reads)
+	{
+		Ring ring;
+		unsigned wanted = (unsigned)std::min<size_t>(reads.size(), MAX_RING_ENTRIES);
+
+		if (!ring.open(wanted))
+			return false;
+
+		// ---------------------------------------------------
+		// SIZING BUFFERS
+		std::vector<LooseRead> files;
+		std::deque<size_t> pending;
+
+		for (FileRead* read : reads)
+		{
+			int fd = ::open(read->path.c_str(), O_RDONLY | O_CLOEXEC);
+			struct stat info;
+
+			if (fd < 0 || fstat(fd, &info) != 0)
+			{
+				if (fd >= 0)
+					close(fd);
+				continue;
+			}
+
+			read->bytes.resize((size_t)info.st_size);
+			read->ok = true;
+
+			if (info.st_size == 0)
+			{
+				close(fd);
+				continue;
+			}
+
+			pending.push_back(files.size());
+			files.push_back({read, fd, 0});
+		}
+
+		// ---------------------------------------------------
+		// SUBMITTING AND REAPING
+		// Short reads go back in the queue for the rest of the file
+		unsigned inFlight = 0;
+		bool failed = false;
+
+		while (!failed && (!pending.empty() || inFlight > 0))
+		{
+			while (!pending.empty() && inFlight < ring.entries)
+			{
+				LooseRead& file = files[pending.front()];
+				size_t length = std::min(file.read->bytes.size() - file.offset, MAX_READ_BYTES);
+
+				ring.read(file.fd, file.read->bytes.data() + file.offset, (unsigned)length, file.offset, pending.front());
+				pending.pop_front();
+				inFlight++;
+			}
+
+			failed = !ring.submit();
+
+			ring.reap([&](uint64_t tag, int result)
+				{
+					LooseRead& file = files[tag];
+					inFlight--;
+
+					if (result == -EINTR || result == -EAGAIN)
+						pending.push_back(tag);
+					else if (result < 0)
+						file.read->ok = false;
+					else if (result == 0)
+						file.read->bytes.resize(file.offset); // shrank since fstat
+					else if ((file.offset += result) < file.read->bytes.size())
+						pending.push_back(tag);
+				});
+		}
+
+		for (LooseRead& file : files)
+		{
+			close(file.fd);
+
+			if (failed)
+				file.read->ok = false;
+		}
+
+		return !failed;
+	}
+#endif
+}
+
+void readBatch(std::vector<FileRead>& reads)
+{
+	if (reads.empty())
+		return;
+
+	PhaseTimer timer(reads[0].path + (reads.size() > 1 ? " (+" + std::to_string(reads.size() - 1) + " more)" : ""), "batch read");
+	std::vector<FileRead*> loose;
+
+	for (FileRead& read : reads)
+	{
+		read.ok = false;
+		read.bytes.clear();
+
+		if (AssetPack::contains(read.path))
+			readBlocking(read);
+		else
+			loose.push_back(&read);
+	}
+
+#ifdef USE_IO_URING
+	if (!loose.empty() && readUring(loose))
+	{
+		// Retrying what io_uring could not read (missing files, or kernels without IORING_OP_READ)
+		loose.erase(std::remove_if(loose.begin(), loose.end(), [](FileRead* read)
+			{ return read->ok; }), loose.end());
+	}
+#endif
+
+	parallelFor(loose.size(), [&](size_t i)
+		{ readBlocking(*loose[i]); });
+}
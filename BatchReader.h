@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// One whole-file read of a batch
+struct FileRead
+{
+	std::string path;
+	std::vector<unsigned char> bytes;
+	bool ok = false;
+};
+
+/// <summary>
+/// Reads every file of the batch at once into buffers sized up front.
+/// On Linux all loose files go out as one io_uring submission; without
+/// io_uring (older kernels, other platforms) they are read on the worker
+/// threads instead. Entries of the mounted asset pack are copied out of
+/// its mapping. Safe to call from several threads, each call has its own ring.
+/// </summary>
+void readBatch(std::vector<FileRead>& reads);
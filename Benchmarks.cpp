@@ -0,0 +1,265 @@
+#include "Benchmarks.h"
+#include "BlockCompression.h"
+#include "Mipmaps.h"
+#include "ObjReader.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "stb_image.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+
+namespace
+{
+	const int BENCHMARK_RUNS = 5;
+
+	// Median wall time of a few runs, in milliseconds
+	double medianMs(const std::function<void()>& run)
+	{
+		std::vector<double> times;
+
+		for (int i = 0; i < BENCHMARK_RUNS; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			run();
+			auto stop = std::chrono::steady_clock::now();
+			times.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+		}
+
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	// Makes a GL context current in a window never shown, null when there is none
+	GLFWwindow* openHiddenWindow(const char* title)
+	{
+		if (!glfwInit())
+			return nullptr;
+
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		GLFWwindow* window = glfwCreateWindow(64, 64, title, NULL, NULL);
+
+		if (window == NULL)
+		{
+			glfwTerminate();
+			return nullptr;
+		}
+
+		glfwMakeContextCurrent(window);
+		gladLoadGL();
+
+		std::printf("%s\n", (const char*)glGetString(GL_RENDERER));
+		return window;
+	}
+
+	// Channel c of texel i as the encoder reads it: grey is replicated, missing alpha is opaque
+	unsigned char sourceChannel(const unsigned char* pixels, int channels, size_t i, int c)
+	{
+		const unsigned char* texel = pixels + i * channels;
+
+		if (c == 3)
+			return channels == 2 || channels == 4 ? texel[channels - 1] : 255;
+
+		return channels < 3 ? texel[0] : texel[c];
+	}
+}
+
+void benchmarkObjParsers(const std::vector<std::string>& paths)
+{
+	// Triangle counts can differ slightly on concave polygons:
+	// tinyobj ear-clips them while readObj fans every polygon
+	std::printf("%-40s %12s %12s %12s %12s %8s\n", "file", "tinyobj tris", "readObj tris", "tinyobj ms", "readObj ms", "speedup");
+
+	for (const std::string& path : paths)
+	{
+		size_t tinyTriangles = 0, readTriangles = 0;
+
+		double tinyMs = medianMs([&]()
+			{
+				tinyobj::attrib_t attributes;
+				std::vector<tinyobj::shape_t> shapes;
+				std::vector<tinyobj::material_t> materials;
+				std::string warning, error;
+				std::string baseDir = path.substr(0, path.find_last_of("/\\") + 1);
+
+				tinyobj::LoadObj(&attributes, &shapes, &materials, &warning, &error, path.c_str(), baseDir.c_str());
+
+				tinyTriangles = 0;
+				for (const tinyobj::shape_t& shape : shapes)
+					tinyTriangles += shape.mesh.indices.size() / 3;
+			});
+
+		double readMs = medianMs([&]()
+			{
+				ObjData data;
+				std::string error;
+
+				readObj(path, data, error);
+				readTriangles = data.corners.size() / 3;
+			});
+
+		std::printf("%-40s %12zu %12zu %12.2f %12.2f %7.1fx\n",
+			path.c_str(),
+			tinyTriangles,
+			readTriangles,
+			tinyMs,
+			readMs,
+			readMs > 0.0 ? tinyMs / readMs : 0.0);
+	}
+}
+
+void benchmarkMipmaps(const std::vector<std::string>& paths)
+{
+	GLFWwindow* window = openHiddenWindow("mip benchmark");
+
+	if (window == nullptr)
+		return;
+
+	std::printf("%-48s %11s %10s %12s %10s %14s\n", "image", "size", "box ms", "kaiser ms", "upload ms", "glGenerate ms");
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (const std::string& path : paths)
+	{
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+
+		if (pixels == nullptr)
+		{
+			std::printf("%-48s could not be decoded\n", path.c_str());
+			continue;
+		}
+
+		GLenum format = channels == 3 ? GL_RGB : GL_RGBA;
+		std::vector<MipLevel> levels;
+
+		double boxMs = medianMs([&]()
+			{ buildMipChain(pixels, width, height, channels, levels); });
+
+		MipOptions kaiser;
+		kaiser.filter = MipFilter::Kaiser;
+		kaiser.srgb = true;
+
+		double kaiserMs = medianMs([&]()
+			{ buildMipChain(pixels, width, height, channels, levels, kaiser); });
+
+		// The finished chain, level by level
+		double uploadMs = medianMs([&]()
+			{
+				glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+
+				for (size_t i = 0; i < levels.size(); i++)
+					glTexImage2D(GL_TEXTURE_2D, (GLint)i + 1, format, levels[i].width, levels[i].height, 0,
+						format, GL_UNSIGNED_BYTE, levels[i].pixels.data());
+
+				glFinish();
+			});
+
+		// The base level alone, the driver filtering the rest
+		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+		glFinish();
+
+		double generateMs = medianMs([&]()
+			{
+				glGenerateMipmap(GL_TEXTURE_2D);
+				glFinish();
+			});
+
+		std::string size = std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(channels);
+
+		std::printf("%-48s %11s %10.2f %12.2f %10.2f %14.2f\n", path.c_str(), size.c_str(), boxMs, kaiserMs, uploadMs, generateMs);
+		stbi_image_free(pixels);
+	}
+
+	glDeleteTextures(1, &texture);
+	glfwDestroyWindow(window);
+	glfwTerminate();
+}
+
+void benchmarkCompression(const std::vector<std::string>& paths)
+{
+	GLFWwindow* window = openHiddenWindow("compression benchmark");
+
+	if (window == nullptr)
+		return;
+
+	// BC5 is core, BC1 and BC3 need S3TC
+	std::vector<BlockFormat> formats = {BlockFormat::BC5};
+
+	if (blockCompressionSupported())
+		formats.insert(formats.begin(), {BlockFormat::BC1, BlockFormat::BC3});
+
+	std::printf("%-48s %11s %6s %10s %8s %10s\n", "image", "size", "format", "encode ms", "RMSE", "ratio");
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	for (const std::string& path : paths)
+	{
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+
+		if (pixels == nullptr)
+		{
+			std::printf("%-48s could not be decoded\n", path.c_str());
+			continue;
+		}
+
+		std::string size = std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(channels);
+		size_t texels = (size_t)width * height;
+		std::vector<unsigned char> decoded(texels * 4);
+
+		for (BlockFormat format : formats)
+		{
+			std::vector<unsigned char> blocks(imageBytes(format, width, height, channels));
+
+			double encodeMs = medianMs([&]()
+				{ compressImage(pixels, width, height, channels, format, blocks.data()); });
+
+			// Decoded by the driver, the way the shaders will see it
+			glCompressedTexImage2D(GL_TEXTURE_2D, 0, compressedFormat(format), width, height, 0,
+				(GLsizei)blocks.size(), blocks.data());
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+
+			// BC1 keeps colour, BC3 colour and alpha, BC5 the first two channels (x and y of a normal map)
+			int kept = format == BlockFormat::BC1 ? 3 : format == BlockFormat::BC3 ? 4 : 2;
+			double squares = 0.0;
+
+			for (size_t i = 0; i < texels; i++)
+			{
+				for (int c = 0; c < kept; c++)
+				{
+					// BC5 takes the second channel as it is, alpha included on grey + alpha images
+					int source = format == BlockFormat::BC5 && c == 1 && channels == 2 ? pixels[i * 2 + 1] :
+						sourceChannel(pixels, channels, i, c);
+					double difference = (double)decoded[i * 4 + c] - source;
+					squares += difference * difference;
+				}
+			}
+
+			double rmse = std::sqrt(squares / ((double)texels * kept));
+			double ratio = (double)texels * channels / blocks.size();
+
+			std::printf("%-48s %11s %6s %10.2f %8.2f %9.1fx\n", path.c_str(), size.c_str(), blockFormatName(format),
+				encodeMs, rmse, ratio);
+		}
+
+		stbi_image_free(pixels);
+	}
+
+	glDeleteTextures(1, &texture);
+	glfwDestroyWindow(window);
+	glfwTerminate();
+}
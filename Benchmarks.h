@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Times tinyobj against readObj on each file and prints a table.
+/// Run with: GRAPHIX_MP --bench-obj [files...]
+/// </summary>
+void benchmarkObjParsers(const std::vector<std::string>& paths);
+
+/// <summary>
+/// Times the CPU mip chain builder (box, and Kaiser in linear light) plus
+/// the level by level upload against glGenerateMipmap on each image, in a
+/// hidden window. Run with: GRAPHIX_MP --bench-mips [images...]
+/// </summary>
+void benchmarkMipmaps(const std::vector<std::string>& paths);
+
+/// <summary>
+/// Encodes each image to BC1, BC3 and BC5, times the encoder and reports
+/// the RMSE of what the GPU decodes against the source, over the channels
+/// each format keeps, in a hidden window.
+/// Run with: GRAPHIX_MP --bench-compression [images...]
+/// </summary>
+void benchmarkCompression(const std::vector<std::string>& paths);
@@ -0,0 +1,456 @@
+#include "BlockCompression.h"
+#include "Jobs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace
+{
+	// Rows of blocks per job
+	const int BLOCK_ROWS_PER_JOB = 8;
+
+	// Power iterations towards a block's principal colour axis
+	const int AXIS_ITERATIONS = 4;
+
+	size_t bytesPerBlock(BlockFormat format)
+	{
+		return format == BlockFormat::BC1 ? 8 : 16;
+	}
+
+	// ---------------------------------------------------
+	// 5:6:5 COLOUR
+	inline uint16_t pack565(const int rgb[3])
+	{
+		int r = (std::min(std::max(rgb[0], 0), 255) * 31 + 127) / 255;
+		int g = (std::min(std::max(rgb[1], 0), 255) * 63 + 127) / 255;
+		int b = (std::min(std::max(rgb[2], 0), 255) * 31 + 127) / 255;
+
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	inline void unpack565(uint16_t colour, int rgb[3])
+	{
+		int r = colour >> 11, g = (colour >> 5) & 63, b = colour & 31;
+
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// The four colours a BC1 block with c0 > c1 decodes to, in index order
+	void palette(uint16_t c0, uint16_t c1, int colours[4][3])
+	{
+		unpack565(c0, colours[0]);
+		unpack565(c1, colours[1]);
+
+		for (int k = 0; k < 3; k++)
+		{
+			colours[2][k] = (2 * colours[0][k] + colours[1][k]) / 3;
+			colours[3][k] = (colours[0][k] + 2 * colours[1][k]) / 3;
+		}
+	}
+
+	// Picks the nearest palette colour per texel, returns the squared error of the block
+	int assignIndices(const unsigned char texels[16][3], const int colours[4][3], int indices[16])
+	{
+		int error = 0;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestDistance = 0;
+
+			for (int c = 0; c < 4; c++)
+			{
+				int dr = texels[i][0] - colours[c][0];
+				int dg = texels[i][1] - colours[c][1];
+				int db = texels[i][2] - colours[c][2];
+				int distance = dr * dr + dg * dg + db * db;
+
+				if (c == 0 || distance < bestDistance)
+				{
+					best = c;
+					bestDistance = distance;
+				}
+			}
+
+			indices[i] = best;
+			error += bestDistance;
+		}
+
+		return error;
+	}
+
+	/// <summary>
+	/// Endpoints that fit the texels best in the least squares sense for
+	/// fixed indices. False when the indices use a single endpoint.
+	/// </summary>
+	bool refineEndpoints(const unsigned char texels[16][3], const int indices[16], int first[3], int second[3])
+	{
+		// Share of the first endpoint per index
+		const float WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[3] = {}, bx[3] = {};
+
+		for (int i = 0; i < 16; i++)
+		{
+			float a = WEIGHTS[indices[i]], b = 1.0f - a;
+
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+
+			for (int k = 0; k < 3; k++)
+			{
+				ax[k] += a * texels[i][k];
+				bx[k] += b * texels[i][k];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+
+		if (determinant < 1e-4f)
+			return false;
+
+		for (int k = 0; k < 3; k++)
+		{
+			first[k] = (int)((ax[k] * bb - bx[k] * ab) / determinant + 0.5f);
+			second[k] = (int)((bx[k] * aa - ax[k] * ab) / determinant + 0.5f);
+		}
+
+		return true;
+	}
+
+	// Writes endpoints and indices in 4-colour order (c0 > c1), returns the block's error
+	int finishColourBlock(const unsigned char texels[16][3], uint16_t c0, uint16_t c1, unsigned char* out, bool write)
+	{
+		int indices[16] = {};
+		int error = 0;
+
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		if (c0 == c1)
+		{
+			// Only index 0 decodes to the colour in every mode
+			int colour[3];
+			unpack565(c0, colour);
+
+			for (int i = 0; i < 16; i++)
+			{
+				for (int k = 0; k < 3; k++)
+					error += (texels[i][k] - colour[k]) * (texels[i][k] - colour[k]);
+			}
+		}
+		else
+		{
+			int colours[4][3];
+			palette(c0, c1, colours);
+			error = assignIndices(texels, colours, indices);
+		}
+
+		if (write)
+		{
+			uint32_t bits = 0;
+
+			for (int i = 0; i < 16; i++)
+				bits |= (uint32_t)indices[i] << (2 * i);
+
+			out[0] = (unsigned char)(c0 & 0xFF);
+			out[1] = (unsigned char)(c0 >> 8);
+			out[2] = (unsigned char)(c1 & 0xFF);
+			out[3] = (unsigned char)(c1 >> 8);
+			std::memcpy(out + 4, &bits, 4);
+		}
+
+		return error;
+	}
+
+	// ---------------------------------------------------
+	// BC1 COLOUR BLOCK
+	// Endpoints from the extremes along the principal axis (inset like
+	// stb_dxt), then one least squares refinement kept if it helps
+	void encodeColourBlock(const unsigned char texels[16][3], unsigned char* out)
+	{
+		float mean[3] = {};
+
+		for (int i = 0; i < 16; i++)
+		{
+			for (int k = 0; k < 3; k++)
+				mean[k] += texels[i][k] / 16.0f;
+		}
+
+		float covariance[6] = {};
+
+		for (int i = 0; i < 16; i++)
+		{
+			float r = texels[i][0] - mean[0], g = texels[i][1] - mean[1], b = texels[i][2] - mean[2];
+
+			covariance[0] += r * r;
+			covariance[1] += r * g;
+			covariance[2] += r * b;
+			covariance[3] += g * g;
+			covariance[4] += g * b;
+			covariance[5] += b * b;
+		}
+
+		float axis[3] = {1.0f, 1.0f, 1.0f};
+
+		for (int iteration = 0; iteration < AXIS_ITERATIONS; iteration++)
+		{
+			float next[3] = {
+				covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+				covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+				covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]};
+			float length = std::max(std::max(std::abs(next[0]), std::abs(next[1])), std::abs(next[2]));
+
+			// A flat block, any axis will do
+			if (length < 1e-6f)
+				break;
+
+			for (int k = 0; k < 3; k++)
+				axis[k] = next[k] / length;
+		}
+
+		int lowest = 0, highest = 0;
+		float minDot = 0.0f, maxDot = 0.0f;
+
+		for (int i = 0; i < 16; i++)
+		{
+			float dot = texels[i][0] * axis[0] + texels[i][1] * axis[1] + texels[i][2] * axis[2];
+
+			if (i == 0 || dot < minDot)
+			{
+				minDot = dot;
+				lowest = i;
+			}
+
+			if (i == 0 || dot > maxDot)
+			{
+				maxDot = dot;
+				highest = i;
+			}
+		}
+
+		int first[3], second[3];
+
+		for (int k = 0; k < 3; k++)
+		{
+			int inset = (texels[highest][k] - texels[lowest][k]) / 16;
+			first[k] = texels[highest][k] - inset;
+			second[k] = texels[lowest][k] + inset;
+		}
+
+		uint16_t c0 = pack565(first), c1 = pack565(second);
+		int error = finishColourBlock(texels, c0, c1, out, false);
+
+		if (error > 0 && c0 != c1)
+		{
+			int colours[4][3], indices[16];
+			palette(std::max(c0, c1), std::min(c0, c1), colours);
+			assignIndices(texels, colours, indices);
+
+			if (refineEndpoints(texels, indices, first, second))
+			{
+				uint16_t r0 = pack565(first), r1 = pack565(second);
+
+				if (finishColourBlock(texels, r0, r1, out, false) < error)
+				{
+					c0 = r0;
+					c1 = r1;
+				}
+			}
+		}
+
+		finishColourBlock(texels, c0, c1, out, true);
+	}
+
+	// ---------------------------------------------------
+	// BC4 CHANNEL BLOCK (BC3 ALPHA, BC5 X AND Y)
+	// Eight-value mode between the block's extremes
+	void encodeChannelBlock(const unsigned char values[16], unsigned char* out)
+	{
+		int lowest = 255, highest = 0;
+
+		for (int i = 0; i < 16; i++)
+		{
+			lowest = std::min(lowest, (int)values[i]);
+			highest = std::max(highest, (int)values[i]);
+		}
+
+		uint64_t bits = 0;
+
+		if (highest > lowest)
+		{
+			int range = highest - lowest;
+
+			for (int i = 0; i < 16; i++)
+			{
+				// Steps down from the highest value: 0 and 7 are the endpoints, 1..6 lie between
+				int step = ((highest - values[i]) * 7 + range / 2) / range;
+				uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+
+				bits |= index << (3 * i);
+			}
+		}
+
+		out[0] = (unsigned char)highest;
+		out[1] = (unsigned char)lowest;
+
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (unsigned char)(bits >> (8 * i));
+	}
+
+	// One block: gathers its texels (edges repeated) and encodes them
+	void encodeBlock(const unsigned char* pixels, int width, int height, int channels,
+		BlockFormat format, int blockX, int blockY, unsigned char* out)
+	{
+		unsigned char colour[16][3];
+		unsigned char alpha[16];
+		unsigned char x[16], y[16];
+		bool hasAlpha = channels == 2 || channels == 4;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int px = std::min(blockX * 4 + (i & 3), width - 1);
+			int py = std::min(blockY * 4 + (i >> 2), height - 1);
+			const unsigned char* texel = pixels + ((size_t)py * width + px) * channels;
+
+			for (int k = 0; k < 3; k++)
+				colour[i][k] = texel[channels >= 3 ? k : 0];
+
+			alpha[i] = hasAlpha ? texel[channels - 1] : 255;
+			x[i] = texel[0];
+			y[i] = texel[std::min(1, channels - 1)];
+		}
+
+		switch (format)
+		{
+		case BlockFormat::BC1:
+			encodeColourBlock(colour, out);
+			break;
+		case BlockFormat::BC3:
+			encodeChannelBlock(alpha, out);
+			encodeColourBlock(colour, out + 8);
+			break;
+		case BlockFormat::BC5:
+			encodeChannelBlock(x, out);
+			encodeChannelBlock(y, out + 8);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+GLenum compressedFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BlockFormat::BC5:
+		return GL_COMPRESSED_RG_RGTC2;
+	default:
+		return GL_NONE;
+	}
+}
+
+const char* blockFormatName(BlockFormat format)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1:
+		return "bc1";
+	case BlockFormat::BC3:
+		return "bc3";
+	case BlockFormat::BC5:
+		return "bc5";
+	default:
+		return "none";
+	}
+}
+
+BlockFormat blockFormatOf(GLint internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		return BlockFormat::BC1;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return BlockFormat::BC3;
+	case GL_COMPRESSED_RG_RGTC2:
+		return BlockFormat::BC5;
+	default:
+		return BlockFormat::None;
+	}
+}
+
+size_t imageBytes(BlockFormat format, int width, int height, int channels)
+{
+	if (format == BlockFormat::None)
+		return (size_t)width * height * channels;
+
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * bytesPerBlock(format);
+}
+
+bool isOpaque(const unsigned char* pixels, int width, int height, int channels)
+{
+	if (channels != 2 && channels != 4)
+		return true;
+
+	size_t count = (size_t)width * height;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (pixels[i * channels + channels - 1] != 255)
+			return false;
+	}
+
+	return true;
+}
+
+void compressImage(const unsigned char* pixels, int width, int height, int channels,
+	BlockFormat format, unsigned char* blocks)
+{
+	if (format == BlockFormat::None)
+		return;
+
+	int blocksX = (width + 3) / 4;
+	int blocksY = (height + 3) / 4;
+	size_t blockSize = bytesPerBlock(format);
+	size_t bands = (size_t)(blocksY + BLOCK_ROWS_PER_JOB - 1) / BLOCK_ROWS_PER_JOB;
+
+	parallelFor(bands, [&](size_t band)
+		{
+			int first = (int)band * BLOCK_ROWS_PER_JOB;
+			int last = std::min(first + BLOCK_ROWS_PER_JOB, blocksY);
+
+			for (int by = first; by < last; by++)
+			{
+				for (int bx = 0; bx < blocksX; bx++)
+					encodeBlock(pixels, width, height, channels, format, bx, by,
+						blocks + ((size_t)by * blocksX + bx) * blockSize);
+			}
+		});
+}
+
+bool blockCompressionSupported()
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+	for (GLint i = 0; i < count; i++)
+	{
+		const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+
+		if (name && std::string(name) == "GL_EXT_texture_compression_s3tc")
+			return true;
+	}
+
+	return false;
+}
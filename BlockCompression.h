@@ -0,0 +1,52 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// S3TC formats come from EXT_texture_compression_s3tc, which glad was generated without
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Layout of the texels of a texture; the values are stored in texture caches
+enum class BlockFormat : uint32_t
+{
+	// Uncompressed 8-bit channels
+	None = 0,
+	// 8 bytes per 4x4 block, opaque colour
+	BC1 = 1,
+	// 16 bytes per 4x4 block, BC1 colour plus interpolated alpha
+	BC3 = 2,
+	// 16 bytes per 4x4 block, two interpolated channels (normal map x and y)
+	BC5 = 3
+};
+
+// GL internal format of the blocks (GL_NONE for None)
+GLenum compressedFormat(BlockFormat format);
+// Format of a GL internal format, None for anything not block-compressed
+BlockFormat blockFormatOf(GLint internalFormat);
+// Lowercase name ("bc1", "none"), for file names and reports
+const char* blockFormatName(BlockFormat format);
+
+// Bytes of an image: whole 4x4 blocks when compressed, tightly packed texels otherwise
+size_t imageBytes(BlockFormat format, int width, int height, int channels);
+
+// False when an RGBA or grey + alpha image has any texel less than fully opaque
+bool isOpaque(const unsigned char* pixels, int width, int height, int channels);
+
+/// <summary>
+/// Encodes an 8-bit image (1 to 4 channels) to blocks, imageBytes(format...)
+/// of them, in rows of blocks split across the worker threads. Colour comes
+/// from the first three channels (grey is replicated), BC3 alpha from the
+/// last one of a grey + alpha or RGBA image, BC5 from the first two.
+/// Images whose sides are not multiples of 4 repeat their edge texels.
+/// </summary>
+void compressImage(const unsigned char* pixels, int width, int height, int channels,
+	BlockFormat format, unsigned char* blocks);
+
+// True when the context samples BC1 and BC3 (S3TC); BC5 (RGTC) is core since GL 3.0
+bool blockCompressionSupported();
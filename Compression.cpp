@@ -0,0 +1,195 @@
+#include "Compression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	// Block format limits: matches are at least 4 bytes long, the last match
+	// starts 12 bytes before the end and the last 5 bytes are always literals
+	const size_t MIN_MATCH = 4;
+	const size_t MATCH_START_LIMIT = 12;
+	const size_t LAST_LITERALS = 5;
+	const size_t MAX_OFFSET = 65535;
+
+	const int HASH_BITS = 16;
+
+	inline uint32_t read32(const unsigned char* p)
+	{
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t hash32(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	// Lengths past 15 spill into extra bytes of 255 and a remainder
+	void writeLength(std::vector<unsigned char>& block, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+			block.push_back(255);
+
+		block.push_back((unsigned char)length);
+	}
+
+	void writeSequence(std::vector<unsigned char>& block,
+		const unsigned char* literals,
+		size_t literalCount,
+		size_t offset,
+		size_t matchLength)
+	{
+		size_t token = block.size();
+		block.push_back((unsigned char)(std::min<size_t>(literalCount, 15) << 4));
+
+		if (literalCount >= 15)
+			writeLength(block, literalCount - 15);
+
+		block.insert(block.end(), literals, literals + literalCount);
+
+		// The closing sequence has literals only
+		if (matchLength == 0)
+			return;
+
+		block.push_back((unsigned char)(offset & 0xFF));
+		block.push_back((unsigned char)(offset >> 8));
+
+		size_t extra = matchLength - MIN_MATCH;
+		block[token] |= (unsigned char)std::min<size_t>(extra, 15);
+
+		if (extra >= 15)
+			writeLength(block, extra - 15);
+	}
+
+	// Reads the extra bytes of a length, false when the block ends first
+	bool readLength(const unsigned char* block, size_t blockSize, size_t& position, size_t& length)
+	{
+		unsigned char byte;
+
+		do
+		{
+			if (position >= blockSize)
+				return false;
+
+			byte = block[position++];
+			length += byte;
+		} while (byte == 255);
+
+		return true;
+	}
+}
+
+void lz4Compress(const unsigned char* source, size_t size, std::vector<unsigned char>& block)
+{
+	block.clear();
+	block.reserve(size + size / 255 + 16);
+
+	size_t anchor = 0;
+
+	if (size > MATCH_START_LIMIT)
+	{
+		// Position + 1 of the last sequence seen per hash, 0 when none
+		std::vector<uint32_t> table((size_t)1 << HASH_BITS, 0);
+		size_t last = size - MATCH_START_LIMIT;
+		size_t i = 0;
+
+		while (i <= last)
+		{
+			uint32_t sequence = read32(source + i);
+			uint32_t& slot = table[hash32(sequence)];
+			size_t candidate = slot;
+			slot = (uint32_t)(i + 1);
+
+			if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET || read32(source + candidate - 1) != sequence)
+			{
+				i++;
+				continue;
+			}
+
+			size_t match = candidate - 1;
+			size_t length = MIN_MATCH;
+			size_t maxLength = size - LAST_LITERALS - i;
+
+			while (length < maxLength && source[i + length] == source[match + length])
+				length++;
+
+			// Taking back literals that also match
+			while (i > anchor && match > 0 && source[i - 1] == source[match - 1])
+			{
+				i--;
+				match--;
+				length++;
+			}
+
+			writeSequence(block, source + anchor, i - anchor, i - match, length);
+
+			i += length;
+			anchor = i;
+		}
+	}
+
+	writeSequence(block, source + anchor, size - anchor, 0, 0);
+}
+
+bool lz4Decompress(const unsigned char* block, size_t blockSize, unsigned char* destination, size_t size)
+{
+	size_t in = 0;
+	size_t out = 0;
+
+	while (in < blockSize)
+	{
+		unsigned char token = block[in++];
+
+		// ---------------------------------------------------
+		// LITERALS
+		size_t literalCount = token >> 4;
+
+		if (literalCount == 15 && !readLength(block, blockSize, in, literalCount))
+			return false;
+
+		if (literalCount > blockSize - in || literalCount > size - out)
+			return false;
+
+		std::memcpy(destination + out, block + in, literalCount);
+		in += literalCount;
+		out += literalCount;
+
+		// The last sequence ends after its literals
+		if (in == blockSize)
+			break;
+
+		// ---------------------------------------------------
+		// MATCH
+		if (blockSize - in < 2)
+			return false;
+
+		size_t offset = block[in] | ((size_t)block[in + 1] << 8);
+		in += 2;
+
+		if (offset == 0 || offset > out)
+			return false;
+
+		size_t length = token & 15;
+
+		if (length == 15 && !readLength(block, blockSize, in, length))
+			return false;
+
+		length += MIN_MATCH;
+
+		if (length > size - out)
+			return false;
+
+		// Byte by byte, the match may overlap the bytes it is producing
+		const unsigned char* from = destination + out - offset;
+
+		for (size_t k = 0; k < length; k++)
+			destination[out + k] = from[k];
+
+		out += length;
+	}
+
+	return out == size;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/// <summary>
+/// Compresses bytes into a raw LZ4 block (no frame header): greedy single
+/// hash lookups, so it trades some ratio for speed. Readable by any LZ4 decoder.
+/// </summary>
+void lz4Compress(const unsigned char* source, size_t size, std::vector<unsigned char>& block);
+
+/// <summary>
+/// Decodes a raw LZ4 block into exactly size bytes.
+/// Fails instead of reading or writing out of bounds on a corrupt block.
+/// </summary>
+bool lz4Decompress(const unsigned char* block, size_t blockSize, unsigned char* destination, size_t size);
@@ -0,0 +1,286 @@
+#include "CubemapCache.h"
+#include "BatchReader.h"
+#include "Jobs.h"
+#include "Mipmaps.h"
+#include "Profiler.h"
+#include "TextureUploads.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace
+{
+	const uint64_t BLOB_ALIGNMENT = 16;
+
+	inline uint64_t alignUp(uint64_t value)
+	{
+		return (value + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+	}
+
+	// Header of the bake in bytes when it is well formed, null otherwise
+	const CubemapCacheHeader* validate(const unsigned char* bytes, size_t size)
+	{
+		if (bytes == nullptr || size < sizeof(CubemapCacheHeader))
+			return nullptr;
+
+		const CubemapCacheHeader* candidate = (const CubemapCacheHeader*)bytes;
+
+		bool valid = candidate->magic == CUBEMAP_CACHE_MAGIC &&
+			candidate->version == CUBEMAP_CACHE_VERSION &&
+			candidate->levelCount >= 1 &&
+			candidate->levelCount <= MAX_TEXTURE_LEVELS;
+
+		for (uint32_t i = 0; valid && i < candidate->levelCount; i++)
+		{
+			const TextureLevel& level = candidate->levels[i];
+
+			valid = level.size == (uint64_t)level.width * level.height * candidate->channels &&
+				level.offset <= size &&
+				level.size * 6 <= size - level.offset;
+		}
+
+		return valid ? candidate : nullptr;
+	}
+}
+
+bool CubemapCache::open(const std::string& path, uint64_t sourceHash)
+{
+	close();
+
+	if (!this->file.open(path))
+		return false;
+
+	this->header = validate(this->file.data(), this->file.size());
+
+	if (this->header != nullptr && this->header->sourceHash != sourceHash)
+		this->header = nullptr;
+
+	if (this->header == nullptr)
+		this->file.close();
+
+	return this->header != nullptr;
+}
+
+bool CubemapCache::open(std::vector<unsigned char>&& baked)
+{
+	close();
+
+	this->memory = std::move(baked);
+	this->header = validate(this->memory.data(), this->memory.size());
+
+	if (this->header == nullptr)
+		this->memory.clear();
+
+	return this->header != nullptr;
+}
+
+void CubemapCache::close()
+{
+	this->header = nullptr;
+	this->file.close();
+	this->memory.clear();
+}
+
+size_t CubemapCache::textureBytes(int firstLevel) const
+{
+	size_t bytes = 0;
+
+	for (uint32_t i = (uint32_t)std::max(firstLevel, 0); i < this->header->levelCount; i++)
+		bytes += (size_t)this->header->levels[i].width * this->header->levels[i].height * texelBytes(this->header->internalFormat) * 6;
+
+	return bytes;
+}
+
+void CubemapCache::upload(int firstLevel) const
+{
+	uint32_t first = (uint32_t)std::min(std::max(firstLevel, 0), (int)this->header->levelCount - 1);
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+
+	// The skybox keeps every level, it can have immutable storage
+	TextureUploader::allocate(GL_TEXTURE_CUBE_MAP, (GLsizei)(this->header->levelCount - first), this->header->internalFormat,
+		(GLsizei)this->header->levels[first].width, (GLsizei)this->header->levels[first].height,
+		this->header->pixelFormat, this->header->pixelType);
+
+	for (uint32_t i = first; i < this->header->levelCount; i++)
+	{
+		const TextureLevel& level = this->header->levels[i];
+
+		for (GLenum face = 0; face < 6; face++)
+			TextureUploader::subImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, (GLint)(i - first),
+				(GLsizei)level.width, (GLsizei)level.height,
+				this->header->pixelFormat, this->header->pixelType, getFace(i, face), (size_t)level.size);
+	}
+}
+
+bool CubemapCache::bake(const std::vector<std::string>& facePaths, std::vector<unsigned char>& baked, std::string& error)
+{
+	error.clear();
+
+	if (facePaths.size() != 6)
+	{
+		error = "a cubemap needs six faces";
+		return false;
+	}
+
+	// ---------------------------------------------------
+	// DECODING
+	struct Face
+	{
+		unsigned char* pixels = nullptr;
+		int width = 0, height = 0, channels = 0;
+		std::vector<MipLevel> levels;
+	};
+
+	std::vector<Face> faces(6);
+	std::vector<FileRead> files(6);
+
+	// All six files in one batch, then decoded on the workers
+	for (size_t i = 0; i < 6; i++)
+		files[i].path = facePaths[i];
+
+	readBatch(files);
+
+	parallelFor(6, [&](size_t i)
+	{
+		// Per thread, so it cannot race with the model textures decoding flipped
+		stbi_set_flip_vertically_on_load_thread(false);
+		PhaseTimer timer(facePaths[i], "decode");
+
+		if (files[i].ok)
+			faces[i].pixels = stbi_load_from_memory(files[i].bytes.data(), (int)files[i].bytes.size(),
+				&faces[i].width, &faces[i].height, &faces[i].channels, 0);
+	});
+
+	uint64_t sourceHash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < 6 && error.empty(); i++)
+	{
+		if (faces[i].pixels == nullptr)
+			error = "could not decode " + facePaths[i];
+		else if (faces[i].width != faces[i].height || faces[i].width != faces[0].width)
+			error = facePaths[i] + " is not square or not the size of the other faces";
+		else if (faces[i].channels != faces[0].channels || faces[i].channels < 3)
+			error = facePaths[i] + " is not RGB or RGBA like the other faces";
+		else
+			sourceHash = hashBytes(files[i].bytes.data(), files[i].bytes.size(), sourceHash);
+	}
+
+	// ---------------------------------------------------
+	// MIP CHAINS
+	// Colour faces, filtered like the other colour textures
+	MipOptions options;
+	options.filter = MipFilter::Kaiser;
+	options.srgb = true;
+
+	for (size_t i = 0; i < 6 && error.empty(); i++)
+	{
+		PhaseTimer timer(facePaths[i], "mipmaps");
+		buildMipChain(faces[i].pixels, faces[i].width, faces[i].height, faces[i].channels, faces[i].levels, options);
+	}
+
+	if (error.empty() && faces[0].levels.size() + 1 > MAX_TEXTURE_LEVELS)
+		error = "the faces are too large";
+
+	// ---------------------------------------------------
+	// LAYOUT
+	if (error.empty())
+	{
+		CubemapCacheHeader header = {};
+		header.magic = CUBEMAP_CACHE_MAGIC;
+		header.version = CUBEMAP_CACHE_VERSION;
+		header.sourceHash = sourceHash;
+		header.width = (uint32_t)faces[0].width;
+		header.height = (uint32_t)faces[0].height;
+		header.channels = (uint32_t)faces[0].channels;
+		header.internalFormat = header.channels == 3 ? GL_RGB : GL_RGBA;
+		header.pixelFormat = header.channels == 3 ? GL_RGB : GL_RGBA;
+		header.pixelType = GL_UNSIGNED_BYTE;
+		header.levelCount = (uint32_t)faces[0].levels.size() + 1;
+
+		uint64_t offset = alignUp(sizeof(CubemapCacheHeader));
+
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			TextureLevel& level = header.levels[i];
+
+			level.width = i == 0 ? header.width : (uint32_t)faces[0].levels[i - 1].width;
+			level.height = i == 0 ? header.height : (uint32_t)faces[0].levels[i - 1].height;
+			level.size = (uint64_t)level.width * level.height * header.channels;
+			level.offset = offset;
+
+			offset = alignUp(offset + level.size * 6);
+		}
+
+		baked.assign((size_t)offset, 0);
+		std::memcpy(baked.data(), &header, sizeof(header));
+
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			const TextureLevel& level = header.levels[i];
+
+			for (size_t face = 0; face < 6; face++)
+			{
+				const unsigned char* pixels = i == 0 ? faces[face].pixels : faces[face].levels[i - 1].pixels.data();
+				std::memcpy(baked.data() + level.offset + face * level.size, pixels, (size_t)level.size);
+			}
+		}
+	}
+
+	for (Face& face : faces)
+		stbi_image_free(face.pixels);
+
+	return error.empty();
+}
+
+uint64_t CubemapCache::hashFaces(const std::vector<std::string>& facePaths)
+{
+	// Chained over the files in order, as bake() does
+	uint64_t sourceHash = 14695981039346656037ULL;
+
+	for (const std::string& path : facePaths)
+	{
+		AssetFile file;
+
+		if (!file.open(path))
+			return 0;
+
+		sourceHash = hashBytes(file.data(), file.size(), sourceHash);
+	}
+
+	return sourceHash;
+}
+
+bool CubemapCache::write(const std::string& path, const std::vector<unsigned char>& baked)
+{
+	// Per thread name, as for the texture caches
+	std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	std::error_code code;
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+
+		out.write((const char*)baked.data(), (std::streamsize)baked.size());
+
+		if (!out)
+		{
+			out.close();
+			std::filesystem::remove(temporary, code);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temporary, path, code);
+
+	if (!code)
+		return true;
+
+	std::filesystem::remove(temporary, code);
+	return false;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "AssetPack.h"
+#include "TextureCache.h"
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const uint32_t CUBEMAP_CACHE_MAGIC = 0x42435847; // "GXCB"
+// Bump whenever the decoder, the mip filter or this layout changes so old bakes get rebuilt
+const uint32_t CUBEMAP_CACHE_VERSION = 2;
+
+/// <summary>
+/// On-disk header of a baked cubemap (.cube): the six faces and all their
+/// mip levels in the final GL format. sourceHash covers the six face images
+/// (see hashFaces), a bake made from other faces is rebuilt.
+/// Each level's offset points at its +X face, the other faces follow it
+/// back to back in GL order (+X, -X, +Y, -Y, +Z, -Z); size is one face.
+/// Layout: header | level 0 faces | level 1 faces | ..., levels 16-byte aligned.
+/// </summary>
+struct CubemapCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	int32_t internalFormat;
+	uint32_t pixelFormat;
+	uint32_t pixelType;
+
+	uint32_t levelCount;
+	uint32_t padding;
+	TextureLevel levels[MAX_TEXTURE_LEVELS];
+};
+
+/// <summary>
+/// Baked cubemap, read in one go from the asset pack or a loose file,
+/// or kept in memory straight after baking. Face pointers point into it.
+/// </summary>
+class CubemapCache
+{
+private:
+	AssetFile file;
+	std::vector<unsigned char> memory;
+	const CubemapCacheHeader* header;
+
+public:
+	inline CubemapCache() : header(nullptr) {}
+
+	CubemapCache(const CubemapCache&) = delete;
+	CubemapCache& operator=(const CubemapCache&) = delete;
+
+	// Reads the bake, fails if it is missing, malformed or made from other faces than sourceHash's
+	bool open(const std::string& path, uint64_t sourceHash);
+	// Takes over a bake made by bake(), fails if it is malformed
+	bool open(std::vector<unsigned char>&& baked);
+	void close();
+
+	inline bool isOpen() const
+	{
+		return this->header != nullptr;
+	}
+
+	inline const CubemapCacheHeader& getHeader() const
+	{
+		return *this->header;
+	}
+
+	inline const unsigned char* getFace(uint32_t level, uint32_t face) const
+	{
+		const TextureLevel& entry = this->header->levels[level];
+		const unsigned char* bytes = this->memory.empty() ? this->file.data() : this->memory.data();
+
+		return bytes + entry.offset + face * entry.size;
+	}
+
+	// Estimated GPU memory of the levels from firstLevel down
+	size_t textureBytes(int firstLevel = 0) const;
+
+	/// <summary>
+	/// Allocates the six faces of every level from firstLevel down on the
+	/// bound GL_TEXTURE_CUBE_MAP and fills them with glTexSubImage2D.
+	/// A firstLevel above 0 makes a lower resolution cubemap, its level 0
+	/// being the bake's firstLevel (clamped to the last level).
+	/// </summary>
+	void upload(int firstLevel = 0) const;
+
+	/// <summary>
+	/// Decodes the six face images (in GL order, all square and the same
+	/// size), builds their mip chains in linear light and lays the result
+	/// out as a .cube file in baked. Fails with a message in error.
+	/// </summary>
+	static bool bake(const std::vector<std::string>& facePaths, std::vector<unsigned char>& baked, std::string& error);
+
+	// Hash of the six face files as bake() records it, 0 when one cannot be read
+	static uint64_t hashFaces(const std::vector<std::string>& facePaths);
+
+	// Writes a bake next to the path and renames it over, readers never see it half written
+	static bool write(const std::string& path, const std::vector<unsigned char>& baked);
+};
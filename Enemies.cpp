@@ -5,10 +5,10 @@ enemyPos(pos),
 enemyRot(rot),
 enemyScale(scale) {}
 
-void EnemyClass::draw(GLuint shaderProgram)
+void EnemyClass::draw(GLuint shaderProgram, const glm::mat4& projection, const glm::mat4& view, float viewportHeight)
 {
 	glUseProgram(shaderProgram);
-	glBindVertexArray(this->VAO);
+	glBindVertexArray(this->mesh->VAO);
 
 	// Initialize transformation matrix, and assign position, scaling, and rotation
 	glm::mat4 transformationMatrix = glm::translate(glm::mat4(1.0f), this->enemyPos);
@@ -33,19 +33,19 @@ void EnemyClass::draw(GLuint shaderProgram)
 	unsigned int transformationLoc = glGetUniformLocation(shaderProgram, "transform");
 	glUniformMatrix4fv(transformationLoc, 1, GL_FALSE, glm::value_ptr(transformationMatrix));
 
-	glActiveTexture(GL_TEXTURE0);
-	GLuint tex0Address = glGetUniformLocation(shaderProgram, "tex0");
-	glBindTexture(GL_TEXTURE_2D, this->textures[0]);
-	glUniform1i(tex0Address, 0);
-
-	if (withNormals)
-	{
-		glActiveTexture(GL_TEXTURE1);
-		GLuint tex1Address = glGetUniformLocation(shaderProgram, "norm_tex");
-		glBindTexture(GL_TEXTURE_2D, this->textures[1]);
-		glUniform1i(tex1Address, 1);
-	}
-
-	// Draw
-	glDrawArrays(GL_TRIANGLES, 0, this->vertexData.size() / 5);
+	// Still streaming in
+	if (drawPlaceholder(shaderProgram))
+		return;
+
+	// Only a layer index when the enemies share a texture array
+	bindTextures(shaderProgram);
+
+	// Texture levels for the enemy's size on screen, streamed in over the next frames
+	float perUnit = pixelsPerUnit(transformationMatrix, projection, view, viewportHeight);
+	requestTextureDetail(perUnit);
+
+	// Draw the level that fits the enemy's size on screen, minus the
+	// meshlets outside the frustum or facing away from the camera
+	MeshletCuller culler(transformationMatrix, projection, view);
+	drawSubmeshes(shaderProgram, selectLod(perUnit), &culler);
 }
@@ -10,5 +10,7 @@ public:
 		glm::vec3 rot,
 		float scale);
 
-	void draw(GLuint shaderProgram);
+	// The camera matrices and the viewport height (queried once per frame)
+	// pick the detail level from the on-screen size
+	void draw(GLuint shaderProgram, const glm::mat4& projection, const glm::mat4& view, float viewportHeight);
 };
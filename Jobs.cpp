@@ -0,0 +1,179 @@
+#include "Jobs.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	thread_local bool insideJob = false;
+
+	// One parallelFor call: its indices are claimed by the caller and any idle workers
+	struct Loop
+	{
+		const std::function<void(size_t)>* job;
+		size_t count;
+		std::atomic<size_t> next{0};
+		std::atomic<size_t> finished{0};
+		std::atomic<bool> failed{false};
+		// First exception thrown by a job, rethrown by the caller
+		std::exception_ptr error;
+	};
+
+	/// <summary>
+	/// Workers started once and kept for the whole run, so loops started at
+	/// the same time from different threads share the cores instead of each
+	/// spawning a thread per core.
+	/// </summary>
+	class WorkerPool
+	{
+	public:
+		WorkerPool()
+		{
+			// The thread calling parallelFor takes part instead of idling
+			for (unsigned int i = 0; i + 1 < workerCount(); i++)
+				this->threads.emplace_back([this]() { work(); });
+		}
+
+		~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->stopping = true;
+			}
+
+			this->wake.notify_all();
+
+			for (std::thread& thread : this->threads)
+				thread.join();
+		}
+
+		void run(size_t count, const std::function<void(size_t)>& job)
+		{
+			std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+			loop->job = &job;
+			loop->count = count;
+
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->loops.push_back(loop);
+			}
+
+			this->wake.notify_all();
+
+			insideJob = true;
+			help(*loop);
+			insideJob = false;
+
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				this->done.wait(lock, [&]() { return loop->finished == loop->count; });
+
+				// Workers drop a loop once its indices are all claimed, it may still be queued
+				std::deque<std::shared_ptr<Loop>>::iterator queued = std::find(this->loops.begin(), this->loops.end(), loop);
+				if (queued != this->loops.end())
+					this->loops.erase(queued);
+			}
+
+			if (loop->error)
+				std::rethrow_exception(loop->error);
+		}
+
+	private:
+		std::vector<std::thread> threads;
+		std::deque<std::shared_ptr<Loop>> loops;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		bool stopping = false;
+
+		// Runs indices of the loop until none are left to claim
+		void help(Loop& loop)
+		{
+			for (size_t i = loop.next++; i < loop.count; i = loop.next++)
+			{
+				// After a failure the rest are only counted off
+				if (!loop.failed)
+				{
+					try
+					{
+						(*loop.job)(i);
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> lock(this->mutex);
+
+						if (!loop.error)
+							loop.error = std::current_exception();
+
+						loop.failed = true;
+					}
+				}
+
+				if (++loop.finished == loop.count)
+				{
+					std::lock_guard<std::mutex> lock(this->mutex);
+					this->done.notify_all();
+				}
+			}
+		}
+
+		void work()
+		{
+			insideJob = true;
+
+			for (;;)
+			{
+				std::shared_ptr<Loop> loop;
+
+				{
+					std::unique_lock<std::mutex> lock(this->mutex);
+					this->wake.wait(lock, [&]() { return this->stopping || !this->loops.empty(); });
+
+					if (this->stopping)
+						return;
+
+					loop = this->loops.front();
+
+					// Nothing left to claim, the caller is waiting on the last indices
+					if (loop->next >= loop->count)
+					{
+						this->loops.pop_front();
+						continue;
+					}
+				}
+
+				help(*loop);
+			}
+		}
+	};
+
+	WorkerPool& pool()
+	{
+		static WorkerPool workers;
+		return workers;
+	}
+}
+
+unsigned int workerCount()
+{
+	unsigned int cores = std::thread::hardware_concurrency();
+	return cores == 0 ? 1 : cores;
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)>& job)
+{
+	if (count <= 1 || workerCount() <= 1 || insideJob)
+	{
+		for (size_t i = 0; i < count; i++)
+			job(i);
+		return;
+	}
+
+	pool().run(count, job);
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Number of worker threads used by parallelFor
+unsigned int workerCount();
+
+/// <summary>
+/// Runs job(0) .. job(count - 1) across the worker threads and waits for all of them.
+/// The workers are started once and shared by every caller, so loops running
+/// at the same time from different threads never oversubscribe the cores.
+/// Calls made from inside a job run serially on the calling worker.
+/// When a job throws, the indices not yet started are skipped and the first
+/// exception is rethrown once the running ones have returned.
+/// </summary>
+void parallelFor(size_t count, const std::function<void(size_t)>& job);
@@ -0,0 +1,153 @@
+#include "MappedFile.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : bytes(nullptr),
+	length(0),
+#ifdef _WIN32
+	fileHandle(INVALID_HANDLE_VALUE),
+	mappingHandle(NULL)
+#else
+	fd(-1)
+#endif
+{}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	this->fileHandle = CreateFileA(
+		path.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		NULL,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+		NULL);
+
+	if (this->fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(this->fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	this->mappingHandle = CreateFileMappingA(this->fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (this->mappingHandle == NULL)
+	{
+		close();
+		return false;
+	}
+
+	this->bytes = (const unsigned char*)MapViewOfFile(this->mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (this->bytes == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	this->length = (size_t)fileSize.QuadPart;
+#else
+	this->fd = ::open(path.c_str(), O_RDONLY);
+	if (this->fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(this->fd, &info) != 0 || info.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+	if (view == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	this->bytes = (const unsigned char*)view;
+	this->length = (size_t)info.st_size;
+#endif
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (this->bytes != nullptr)
+		UnmapViewOfFile(this->bytes);
+	if (this->mappingHandle != NULL)
+		CloseHandle(this->mappingHandle);
+	if (this->fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(this->fileHandle);
+
+	this->mappingHandle = NULL;
+	this->fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (this->bytes != nullptr)
+		munmap((void*)this->bytes, this->length);
+	if (this->fd >= 0)
+		::close(this->fd);
+
+	this->fd = -1;
+#endif
+
+	this->bytes = nullptr;
+	this->length = 0;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t hash = seed;
+	size_t i = 0;
+
+	// Eight bytes per step, the tail is mixed in byte by byte
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		std::memcpy(&word, bytes + i, sizeof(word));
+		hash ^= word;
+		hash *= 1099511628211ULL;
+		hash ^= hash >> 32;
+	}
+
+	for (; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+uint64_t hashFile(const std::string& path)
+{
+	MappedFile file;
+
+	if (!file.open(path))
+		return 0;
+
+	return hashBytes(file.data(), file.size());
+}
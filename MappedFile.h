@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// <summary>
+/// Read-only memory mapping of a whole file.
+/// The bytes stay valid until close() is called or the object is destroyed.
+/// </summary>
+class MappedFile
+{
+private:
+	const unsigned char* bytes;
+	size_t length;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fd;
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	inline bool isOpen() const
+	{
+		return this->bytes != nullptr;
+	}
+
+	inline const unsigned char* data() const
+	{
+		return this->bytes;
+	}
+
+	inline size_t size() const
+	{
+		return this->length;
+	}
+};
+
+// 64-bit FNV-1a style hash of a block of bytes (word at a time)
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
+// Hash of a file's contents, 0 when the file cannot be read
+uint64_t hashFile(const std::string& path);
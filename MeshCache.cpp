@@ -0,0 +1,105 @@
+#include "MeshCache.h"
+#include <fstream>
+
+namespace
+{
+	const uint64_t BLOB_ALIGNMENT = 16;
+
+	inline uint64_t alignUp(uint64_t value)
+	{
+		return (value + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+	}
+}
+
+bool MeshCache::open(const std::string& path, uint64_t sourceHash)
+{
+	close();
+
+	if (!this->file.open(path) || this->file.size() < sizeof(MeshCacheHeader))
+	{
+		this->file.close();
+		return false;
+	}
+
+	const MeshCacheHeader* candidate = (const MeshCacheHeader*)this->file.data();
+	uint64_t vertexBytes = (uint64_t)candidate->vertexCount * candidate->vertexStride;
+	uint64_t indexBytes = (uint64_t)candidate->indexCount * sizeof(GLuint);
+	uint64_t submeshBytes = (uint64_t)candidate->submeshCount * sizeof(SubMesh);
+	uint64_t lodBytes = (uint64_t)candidate->lodCount * sizeof(MeshLod);
+	uint64_t meshletBytes = (uint64_t)candidate->meshletCount * sizeof(Meshlet);
+	uint64_t materialBytes = (uint64_t)candidate->materialCount * sizeof(MeshMaterial);
+
+	bool valid = candidate->magic == MESH_CACHE_MAGIC &&
+		candidate->version == MESH_CACHE_VERSION &&
+		candidate->sourceHash == sourceHash &&
+		candidate->attributeCount <= MAX_VERTEX_ATTRIBUTES &&
+		candidate->vertexOffset + vertexBytes <= this->file.size() &&
+		candidate->indexOffset + indexBytes <= this->file.size() &&
+		candidate->submeshOffset + submeshBytes <= this->file.size() &&
+		candidate->lodOffset + lodBytes <= this->file.size() &&
+		candidate->meshletOffset + meshletBytes <= this->file.size() &&
+		candidate->materialOffset + materialBytes <= this->file.size();
+
+	if (!valid)
+	{
+		this->file.close();
+		return false;
+	}
+
+	this->header = candidate;
+	return true;
+}
+
+void MeshCache::close()
+{
+	this->header = nullptr;
+	this->file.close();
+}
+
+bool MeshCache::write(const std::string& path,
+	MeshCacheHeader header,
+	const void* vertices,
+	const GLuint* indices,
+	const SubMesh* submeshes,
+	const MeshLod* lods,
+	const Meshlet* meshlets,
+	const MeshMaterial* materials)
+{
+	uint64_t vertexBytes = (uint64_t)header.vertexCount * header.vertexStride;
+	uint64_t indexBytes = (uint64_t)header.indexCount * sizeof(GLuint);
+	uint64_t submeshBytes = (uint64_t)header.submeshCount * sizeof(SubMesh);
+	uint64_t lodBytes = (uint64_t)header.lodCount * sizeof(MeshLod);
+	uint64_t meshletBytes = (uint64_t)header.meshletCount * sizeof(Meshlet);
+	uint64_t materialBytes = (uint64_t)header.materialCount * sizeof(MeshMaterial);
+
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertexOffset = alignUp(sizeof(MeshCacheHeader));
+	header.indexOffset = alignUp(header.vertexOffset + vertexBytes);
+	header.submeshOffset = alignUp(header.indexOffset + indexBytes);
+	header.lodOffset = alignUp(header.submeshOffset + submeshBytes);
+	header.meshletOffset = alignUp(header.lodOffset + lodBytes);
+	header.materialOffset = alignUp(header.meshletOffset + meshletBytes);
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	const char padding[BLOB_ALIGNMENT] = {};
+
+	out.write((const char*)&header, sizeof(header));
+	out.write(padding, header.vertexOffset - sizeof(header));
+	out.write((const char*)vertices, vertexBytes);
+	out.write(padding, header.indexOffset - (header.vertexOffset + vertexBytes));
+	out.write((const char*)indices, indexBytes);
+	out.write(padding, header.submeshOffset - (header.indexOffset + indexBytes));
+	out.write((const char*)submeshes, submeshBytes);
+	out.write(padding, header.lodOffset - (header.submeshOffset + submeshBytes));
+	out.write((const char*)lods, lodBytes);
+	out.write(padding, header.meshletOffset - (header.lodOffset + lodBytes));
+	out.write((const char*)meshlets, meshletBytes);
+	out.write(padding, header.materialOffset - (header.meshletOffset + meshletBytes));
+	out.write((const char*)materials, materialBytes);
+
+	return (bool)out;
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include "MappedFile.h"
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+
+const uint32_t MESH_CACHE_MAGIC = 0x484D5847; // "GXMH"
+// Bump whenever the loader output or this layout changes so old caches get rebuilt
+const uint32_t MESH_CACHE_VERSION = 7;
+const int MAX_VERTEX_ATTRIBUTES = 8;
+
+// One glVertexAttribPointer entry
+struct VertexAttribute
+{
+	uint32_t location;
+	uint32_t components;
+	uint32_t type;
+	uint32_t normalized;
+	uint32_t offset;
+};
+
+// Contiguous index range drawn with one material
+struct SubMesh
+{
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	int32_t materialId; // -1 when the faces have no material
+};
+
+// Detail level: a run of submeshes drawn instead of the full-resolution ones
+struct MeshLod
+{
+	uint32_t submeshOffset;
+	uint32_t submeshCount;
+	float error; // largest deviation from the full mesh, in object-space units
+};
+
+// Cluster of up to MESHLET_MAX_TRIANGLES triangles with the bounds used to cull it
+struct Meshlet
+{
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	float center[3];
+	float radius;
+	float coneAxis[3];
+	float coneCutoff; // sine of the cone's half angle, 1 when it cannot be culled
+};
+
+const int MAX_MATERIAL_PATH = 256;
+
+// Material entry, the texture path is relative to the working directory
+struct MeshMaterial
+{
+	char diffuseTexture[MAX_MATERIAL_PATH];
+};
+
+/// <summary>
+/// On-disk header of a precooked mesh (.mesh).
+/// Layout: header | vertices | indices | submeshes | lods | meshlets | materials, blobs 16-byte aligned.
+/// </summary>
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+
+	uint32_t vertexCount;
+	uint32_t vertexStride;
+	uint32_t indexCount;
+	uint32_t attributeCount;
+	VertexAttribute attributes[MAX_VERTEX_ATTRIBUTES];
+
+	uint32_t submeshCount;
+	uint32_t lodCount;
+	uint32_t meshletCount;
+	uint32_t materialCount;
+
+	float boundsMin[3];
+	float boundsMax[3];
+
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t submeshOffset;
+	uint64_t lodOffset;
+	uint64_t meshletOffset;
+	uint64_t materialOffset;
+};
+
+/// <summary>
+/// Memory-mapped view of a precooked mesh.
+/// Vertex and index pointers point straight into the mapping.
+/// </summary>
+class MeshCache
+{
+private:
+	MappedFile file;
+	const MeshCacheHeader* header;
+
+public:
+	inline MeshCache() : header(nullptr) {}
+
+	// Maps the cache, fails if it is missing, stale or malformed
+	bool open(const std::string& path, uint64_t sourceHash);
+	void close();
+
+	inline bool isOpen() const
+	{
+		return this->header != nullptr;
+	}
+
+	inline const MeshCacheHeader& getHeader() const
+	{
+		return *this->header;
+	}
+
+	inline const void* getVertices() const
+	{
+		return this->file.data() + this->header->vertexOffset;
+	}
+
+	inline const GLuint* getIndices() const
+	{
+		return (const GLuint*)(this->file.data() + this->header->indexOffset);
+	}
+
+	inline const SubMesh* getSubMeshes() const
+	{
+		return (const SubMesh*)(this->file.data() + this->header->submeshOffset);
+	}
+
+	inline const MeshLod* getLods() const
+	{
+		return (const MeshLod*)(this->file.data() + this->header->lodOffset);
+	}
+
+	inline const Meshlet* getMeshlets() const
+	{
+		return (const Meshlet*)(this->file.data() + this->header->meshletOffset);
+	}
+
+	inline const MeshMaterial* getMaterials() const
+	{
+		return (const MeshMaterial*)(this->file.data() + this->header->materialOffset);
+	}
+
+	// Writes a cache file, offsets in the header are filled in here
+	static bool write(const std::string& path,
+		MeshCacheHeader header,
+		const void* vertices,
+		const GLuint* indices,
+		const SubMesh* submeshes,
+		const MeshLod* lods,
+		const Meshlet* meshlets,
+		const MeshMaterial* materials);
+};
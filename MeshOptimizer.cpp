@@ -0,0 +1,370 @@
+#include "MeshOptimizer.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	// Forsyth scoring constants
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	// Smallest cluster the overdraw pass will cut off
+	const size_t MIN_CLUSTER_TRIANGLES = 64;
+
+	float vertexScore(int cachePosition, int remainingValence)
+	{
+		// Nothing left to draw with this vertex
+		if (remainingValence == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+
+		if (cachePosition >= 0)
+		{
+			// The last triangle's vertices get a fixed score so the next
+			// triangle is not just a neighbour sharing an edge
+			if (cachePosition < 3)
+			{
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else
+			{
+				float scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+			}
+		}
+
+		// Vertices with few triangles left are finished off first
+		score += VALENCE_BOOST_SCALE * std::pow((float)remainingValence, -VALENCE_BOOST_POWER);
+
+		return score;
+	}
+
+	// Cache misses per triangle with a FIFO cache of cacheSize entries
+	std::vector<size_t> fifoMisses(const GLuint* indices, size_t indexCount, size_t vertexCount, int cacheSize)
+	{
+		std::vector<size_t> timestamps(vertexCount, 0);
+		std::vector<size_t> missesPerTriangle(indexCount / 3, 0);
+		size_t time = cacheSize + 1;
+
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			GLuint v = indices[i];
+
+			if (time - timestamps[v] > (size_t)cacheSize)
+			{
+				timestamps[v] = time++;
+				missesPerTriangle[i / 3]++;
+			}
+		}
+
+		return missesPerTriangle;
+	}
+}
+
+VertexCacheStats analyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, int cacheSize)
+{
+	VertexCacheStats stats = {0.0f, 0.0f};
+
+	if (indexCount < 3)
+		return stats;
+
+	std::vector<size_t> misses = fifoMisses(indices, indexCount, vertexCount, cacheSize);
+	size_t totalMisses = 0;
+
+	for (size_t count : misses)
+		totalMisses += count;
+
+	std::vector<bool> used(vertexCount, false);
+	size_t usedVertices = 0;
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		if (!used[indices[i]])
+		{
+			used[indices[i]] = true;
+			usedVertices++;
+		}
+	}
+
+	stats.acmr = (float)totalMisses / (indexCount / 3);
+	stats.atvr = (float)totalMisses / usedVertices;
+
+	return stats;
+}
+
+void optimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+
+	if (triangleCount < 2)
+		return;
+
+	// ---------------------------------------------------
+	// VERTEX -> TRIANGLE ADJACENCY
+	std::vector<GLuint> valence(vertexCount, 0);
+
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		valence[indices[i]]++;
+
+	std::vector<GLuint> firstTriangle(vertexCount + 1, 0);
+
+	for (size_t v = 0; v < vertexCount; v++)
+		firstTriangle[v + 1] = firstTriangle[v] + valence[v];
+
+	std::vector<GLuint> triangles(triangleCount * 3);
+	std::vector<GLuint> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		triangles[cursor[indices[i]]++] = (GLuint)(i / 3);
+
+	// ---------------------------------------------------
+	// INITIAL SCORES
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+
+	for (size_t v = 0; v < vertexCount; v++)
+		score[v] = vertexScore(-1, valence[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+	// ---------------------------------------------------
+	// GREEDY EMISSION
+	std::vector<GLuint> output;
+	output.reserve(triangleCount * 3);
+
+	// LRU cache, with room for the 3 vertices pushed in by each triangle
+	std::vector<GLuint> cache;
+	std::vector<GLuint> nextCache;
+	cache.reserve(VERTEX_CACHE_SIZE + 3);
+	nextCache.reserve(VERTEX_CACHE_SIZE + 3);
+
+	size_t scanCursor = 0;
+	long long best = -1;
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (best < 0 || triangleScore[best] < triangleScore[t])
+			best = (long long)t;
+	}
+
+	while (best >= 0)
+	{
+		const GLuint* triangle = &indices[best * 3];
+		emitted[best] = true;
+		output.insert(output.end(), triangle, triangle + 3);
+
+		// Triangle leaves the adjacency of its vertices
+		for (int c = 0; c < 3; c++)
+		{
+			GLuint v = triangle[c];
+			GLuint* begin = &triangles[firstTriangle[v]];
+			GLuint* end = begin + valence[v];
+			GLuint* found = std::find(begin, end, (GLuint)best);
+
+			std::swap(*found, *(end - 1));
+			valence[v]--;
+		}
+
+		// Triangle's vertices move to the front of the cache
+		nextCache.assign(triangle, triangle + 3);
+
+		for (GLuint v : cache)
+		{
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				nextCache.push_back(v);
+		}
+
+		// Vertices pushed out of the cache lose their position
+		for (size_t i = VERTEX_CACHE_SIZE; i < nextCache.size(); i++)
+		{
+			cachePosition[nextCache[i]] = -1;
+			score[nextCache[i]] = vertexScore(-1, valence[nextCache[i]]);
+		}
+
+		if (nextCache.size() > (size_t)VERTEX_CACHE_SIZE)
+			nextCache.resize(VERTEX_CACHE_SIZE);
+
+		cache.swap(nextCache);
+
+		// Rescoring the cached vertices and their remaining triangles
+		best = -1;
+		float bestScore = -1.0f;
+
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			cachePosition[cache[i]] = (int)i;
+			score[cache[i]] = vertexScore((int)i, valence[cache[i]]);
+		}
+
+		for (GLuint v : cache)
+		{
+			for (GLuint i = 0; i < valence[v]; i++)
+			{
+				GLuint t = triangles[firstTriangle[v] + i];
+				float tScore = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+				triangleScore[t] = tScore;
+
+				if (tScore > bestScore)
+				{
+					bestScore = tScore;
+					best = t;
+				}
+			}
+		}
+
+		// Nothing connected to the cache, carrying on with the next unused triangle
+		if (best < 0)
+		{
+			while (scanCursor < triangleCount && emitted[scanCursor])
+				scanCursor++;
+
+			if (scanCursor < triangleCount)
+				best = (long long)scanCursor;
+		}
+	}
+
+	std::memcpy(indices, output.data(), output.size() * sizeof(GLuint));
+}
+
+void optimizeOverdraw(GLuint* indices, size_t indexCount, const GLfloat* positions, size_t stride)
+{
+	size_t triangleCount = indexCount / 3;
+
+	if (triangleCount < MIN_CLUSTER_TRIANGLES * 2)
+		return;
+
+	GLuint maxIndex = *std::max_element(indices, indices + indexCount);
+	std::vector<size_t> misses = fifoMisses(indices, indexCount, (size_t)maxIndex + 1, VERTEX_CACHE_SIZE);
+
+	// ---------------------------------------------------
+	// CLUSTERS
+	// A new cluster starts where the cache had to restart (all 3 vertices missed)
+	std::vector<size_t> clusterStart;
+	clusterStart.push_back(0);
+
+	for (size_t t = 1; t < triangleCount; t++)
+	{
+		if (misses[t] == 3 && t - clusterStart.back() >= MIN_CLUSTER_TRIANGLES)
+			clusterStart.push_back(t);
+	}
+
+	clusterStart.push_back(triangleCount);
+	size_t clusterCount = clusterStart.size() - 1;
+
+	if (clusterCount < 2)
+		return;
+
+	auto position = [&](GLuint v)
+	{
+		return glm::make_vec3(positions + (size_t)v * stride);
+	};
+
+	// Area-weighted centroid and normal of each cluster
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	std::vector<glm::vec3> centroid(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normal(clusterCount, glm::vec3(0.0f));
+
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		float area = 0.0f;
+
+		for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+		{
+			glm::vec3 a = position(indices[t * 3]);
+			glm::vec3 b = position(indices[t * 3 + 1]);
+			glm::vec3 d = position(indices[t * 3 + 2]);
+
+			glm::vec3 cross = glm::cross(b - a, d - a);
+			float triangleArea = glm::length(cross);
+
+			centroid[c] += (a + b + d) * (triangleArea / 3.0f);
+			normal[c] += cross;
+			area += triangleArea;
+		}
+
+		meshCentroid += centroid[c];
+		meshArea += area;
+
+		if (area > 0.0f)
+			centroid[c] /= area;
+	}
+
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// Clusters facing away from the centre occlude the rest, so they go first
+	std::vector<float> sortKey(clusterCount);
+
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		float length = glm::length(normal[c]);
+		sortKey[c] = length > 0.0f ? glm::dot(centroid[c] - meshCentroid, normal[c] / length) : 0.0f;
+	}
+
+	std::vector<size_t> order(clusterCount);
+
+	for (size_t c = 0; c < clusterCount; c++)
+		order[c] = c;
+
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+		{ return sortKey[a] > sortKey[b]; });
+
+	std::vector<GLuint> output;
+	output.reserve(triangleCount * 3);
+
+	for (size_t c : order)
+		output.insert(output.end(), indices + clusterStart[c] * 3, indices + clusterStart[c + 1] * 3);
+
+	std::memcpy(indices, output.data(), output.size() * sizeof(GLuint));
+}
+
+void optimizeVertexFetch(GLfloat* vertices, size_t vertexCount, size_t stride, GLuint* indices, size_t indexCount)
+{
+	const GLuint UNUSED = 0xFFFFFFFFu;
+	std::vector<GLuint> remap(vertexCount, UNUSED);
+	std::vector<GLfloat> reordered;
+	reordered.reserve(vertexCount * stride);
+
+	GLuint next = 0;
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		GLuint& target = remap[indices[i]];
+
+		if (target == UNUSED)
+		{
+			target = next++;
+			const GLfloat* vertex = vertices + (size_t)indices[i] * stride;
+			reordered.insert(reordered.end(), vertex, vertex + stride);
+		}
+
+		indices[i] = target;
+	}
+
+	// Unreferenced vertices keep their data at the end
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] == UNUSED)
+		{
+			const GLfloat* vertex = vertices + v * stride;
+			reordered.insert(reordered.end(), vertex, vertex + stride);
+		}
+	}
+
+	std::memcpy(vertices, reordered.data(), reordered.size() * sizeof(GLfloat));
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+
+// Post-transform cache size assumed by the optimizer and the statistics
+const int VERTEX_CACHE_SIZE = 32;
+
+struct VertexCacheStats
+{
+	float acmr; // cache misses per triangle (ideal ~0.5, worst 3)
+	float atvr; // cache misses per referenced vertex (ideal 1)
+};
+
+// Simulates a FIFO post-transform cache over the index list
+VertexCacheStats analyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, int cacheSize = 16);
+
+/// <summary>
+/// Reorders triangles for post-transform cache locality (Forsyth's
+/// linear-speed vertex cache optimisation). Only the triangle order changes.
+/// </summary>
+void optimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount);
+
+/// <summary>
+/// Splits a cache-optimized index list into clusters at cache restarts and
+/// sorts the clusters so outward-facing ones are drawn first, which cuts
+/// overdraw while keeping most of the cache locality.
+/// positions points to the first vertex's xyz, stride is in floats.
+/// </summary>
+void optimizeOverdraw(GLuint* indices, size_t indexCount, const GLfloat* positions, size_t stride);
+
+/// <summary>
+/// Reorders vertices in the order the index list first uses them and
+/// remaps the indices, so vertex fetch walks memory linearly.
+/// stride is in floats.
+/// </summary>
+void optimizeVertexFetch(GLfloat* vertices, size_t vertexCount, size_t stride, GLuint* indices, size_t indexCount);
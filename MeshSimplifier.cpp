@@ -0,0 +1,393 @@
+#include "MeshSimplifier.h"
+#include "MeshWelding.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	// Symmetric 4x4 matrix: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33
+	struct Quadric
+	{
+		double a[10];
+	};
+
+	void addPlane(Quadric& q, const glm::dvec3& n, double d)
+	{
+		q.a[0] += n.x * n.x;
+		q.a[1] += n.x * n.y;
+		q.a[2] += n.x * n.z;
+		q.a[3] += n.x * d;
+		q.a[4] += n.y * n.y;
+		q.a[5] += n.y * n.z;
+		q.a[6] += n.y * d;
+		q.a[7] += n.z * n.z;
+		q.a[8] += n.z * d;
+		q.a[9] += d * d;
+	}
+
+	void addQuadric(Quadric& q, const Quadric& other)
+	{
+		for (int i = 0; i < 10; i++)
+			q.a[i] += other.a[i];
+	}
+
+	// Sum of squared distances from p to the planes gathered in q
+	double evaluate(const Quadric& q, const glm::vec3& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+
+		double error = q.a[0] * x * x + 2 * q.a[1] * x * y + 2 * q.a[2] * x * z + 2 * q.a[3] * x +
+			q.a[4] * y * y + 2 * q.a[5] * y * z + 2 * q.a[6] * y +
+			q.a[7] * z * z + 2 * q.a[8] * z +
+			q.a[9];
+
+		return error > 0.0 ? error : 0.0;
+	}
+
+	struct Collapse
+	{
+		GLuint from;
+		GLuint to;
+		double cost;
+	};
+}
+
+size_t simplifyMesh(GLuint* destination,
+	const GLuint* indices,
+	size_t indexCount,
+	const GLfloat* positions,
+	size_t vertexCount,
+	size_t stride,
+	size_t targetIndexCount,
+	float* resultError)
+{
+	auto position = [&](GLuint v)
+	{
+		return glm::make_vec3(positions + (size_t)v * stride);
+	};
+
+	std::vector<GLuint> triangles(indices, indices + indexCount);
+	double maxError = 0.0;
+
+	// ---------------------------------------------------
+	// WELDING
+	// Topology and error work on positions; vertices that only differ in
+	// normal or uv (seams) share one welded vertex, the first at their position
+	std::vector<GLuint> weld(vertexCount);
+	weldPositions(positions, stride, nullptr, vertexCount, weld.data());
+
+	// ---------------------------------------------------
+	// LOCKED VERTICES
+	// Open borders and non-manifold edges: welded edges not used by exactly two triangles
+	std::unordered_map<uint64_t, int> edgeUses;
+	std::vector<bool> locked(vertexCount, false);
+
+	auto edgeKey = [&](GLuint a, GLuint b)
+	{
+		GLuint wa = weld[a], wb = weld[b];
+		return wa < wb ? ((uint64_t)wa << 32) | wb : ((uint64_t)wb << 32) | wa;
+	};
+
+	for (size_t i = 0; i < triangles.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+			edgeUses[edgeKey(triangles[i + e], triangles[i + (e + 1) % 3])]++;
+	}
+
+	for (size_t i = 0; i < triangles.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			GLuint a = triangles[i + e], b = triangles[i + (e + 1) % 3];
+
+			if (edgeUses[edgeKey(a, b)] != 2)
+			{
+				locked[weld[a]] = true;
+				locked[weld[b]] = true;
+			}
+		}
+	}
+
+	// ---------------------------------------------------
+	// QUADRICS
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+
+	for (size_t i = 0; i < triangles.size(); i += 3)
+	{
+		glm::dvec3 a = position(triangles[i]);
+		glm::dvec3 b = position(triangles[i + 1]);
+		glm::dvec3 c = position(triangles[i + 2]);
+		glm::dvec3 normal = glm::cross(b - a, c - a);
+		double length = glm::length(normal);
+
+		if (length <= 0.0)
+			continue;
+
+		normal /= length;
+		double d = -glm::dot(normal, a);
+
+		for (int k = 0; k < 3; k++)
+			addPlane(quadrics[weld[triangles[i + k]]], normal, d);
+	}
+
+	// ---------------------------------------------------
+	// COLLAPSE PASSES
+	// Each pass takes the cheapest independent collapses, then rebuilds adjacency
+	std::vector<GLuint> firstTriangle(vertexCount + 1);
+	std::vector<GLuint> adjacency;
+	std::vector<GLuint> collapseTo(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<Collapse> candidates;
+	std::vector<std::pair<GLuint, GLuint>> wedgeMap;
+	std::vector<GLuint> fromRing, toRing;
+
+	// Welded vertices sharing a triangle with vertex v, sorted
+	auto gatherRing = [&](GLuint v, std::vector<GLuint>& ring)
+	{
+		ring.clear();
+
+		for (GLuint k = firstTriangle[v]; k < firstTriangle[v + 1]; k++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				GLuint corner = weld[triangles[adjacency[k] * 3 + c]];
+
+				if (corner != v)
+					ring.push_back(corner);
+			}
+		}
+
+		std::sort(ring.begin(), ring.end());
+		ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+	};
+
+	while (triangles.size() > targetIndexCount)
+	{
+		size_t triangleCount = triangles.size() / 3;
+
+		// Triangles around each welded vertex
+		std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+
+		for (GLuint v : triangles)
+			firstTriangle[weld[v] + 1]++;
+
+		for (size_t v = 0; v < vertexCount; v++)
+			firstTriangle[v + 1] += firstTriangle[v];
+
+		adjacency.resize(triangles.size());
+		std::vector<GLuint> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+
+		for (size_t i = 0; i < triangles.size(); i++)
+			adjacency[cursor[weld[triangles[i]]]++] = (GLuint)(i / 3);
+
+		candidates.clear();
+
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				GLuint a = weld[triangles[i + e]];
+				GLuint b = weld[triangles[i + (e + 1) % 3]];
+
+				for (int direction = 0; direction < 2; direction++)
+				{
+					GLuint from = direction == 0 ? a : b;
+					GLuint to = direction == 0 ? b : a;
+
+					if (locked[from] || from == to)
+						continue;
+
+					Quadric q = quadrics[from];
+					addQuadric(q, quadrics[to]);
+					candidates.push_back({from, to, evaluate(q, position(to))});
+				}
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y)
+			{ return x.cost < y.cost; });
+
+		size_t needed = std::max<size_t>(1, (triangleCount - targetIndexCount / 3) / 2);
+		size_t collapses = 0;
+
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			collapseTo[v] = (GLuint)v;
+			touched[v] = false;
+		}
+
+		for (const Collapse& candidate : candidates)
+		{
+			if (collapses >= needed)
+				break;
+
+			GLuint from = candidate.from, to = candidate.to;
+
+			if (touched[from] || touched[to])
+				continue;
+
+			// Each vertex at 'from' moves onto the vertex at 'to' it shares a
+			// triangle with, so seams collapse along themselves and keep their uvs
+			wedgeMap.clear();
+			int shared = 0;
+			bool valid = true;
+
+			for (GLuint k = firstTriangle[from]; k < firstTriangle[from + 1] && valid; k++)
+			{
+				const GLuint* triangle = &triangles[adjacency[k] * 3];
+				GLuint fromVertex = 0, toVertex = 0;
+				bool hasTo = false;
+
+				for (int c = 0; c < 3; c++)
+				{
+					if (weld[triangle[c]] == from)
+						fromVertex = triangle[c];
+
+					if (weld[triangle[c]] == to)
+					{
+						toVertex = triangle[c];
+						hasTo = true;
+					}
+				}
+
+				if (!hasTo)
+					continue;
+
+				shared++;
+
+				for (const auto& pair : wedgeMap)
+				{
+					if (pair.first == fromVertex && pair.second != toVertex)
+						valid = false;
+				}
+
+				wedgeMap.push_back({fromVertex, toVertex});
+			}
+
+			// An interior edge has exactly two triangles
+			if (!valid || shared != 2)
+				continue;
+
+			// Link condition: the one-rings of both ends only meet at the two
+			// vertices opposite the edge, anything else would pinch the surface
+			// into a non-manifold edge or fold a triangle pair onto itself
+			gatherRing(from, fromRing);
+			gatherRing(to, toRing);
+
+			size_t common = 0;
+
+			for (size_t i = 0, j = 0; i < fromRing.size() && j < toRing.size();)
+			{
+				if (fromRing[i] < toRing[j])
+					i++;
+				else if (toRing[j] < fromRing[i])
+					j++;
+				else
+				{
+					common++;
+					i++;
+					j++;
+				}
+			}
+
+			if (common != 2)
+				continue;
+
+			glm::vec3 target = position(to);
+
+			for (GLuint k = firstTriangle[from]; k < firstTriangle[from + 1] && valid; k++)
+			{
+				const GLuint* triangle = &triangles[adjacency[k] * 3];
+				GLuint fromVertex = 0;
+				bool hasTo = false;
+
+				for (int c = 0; c < 3; c++)
+				{
+					if (weld[triangle[c]] == from)
+						fromVertex = triangle[c];
+
+					hasTo = hasTo || weld[triangle[c]] == to;
+				}
+
+				if (hasTo)
+					continue;
+
+				// A vertex with no partner across the edge (the seam turns away) stays put
+				bool mapped = false;
+
+				for (const auto& pair : wedgeMap)
+					mapped = mapped || pair.first == fromVertex;
+
+				// The triangle must not fold over once 'from' moves onto 'to'
+				glm::vec3 p[3], q[3];
+
+				for (int c = 0; c < 3; c++)
+				{
+					p[c] = position(triangle[c]);
+					q[c] = weld[triangle[c]] == from ? target : p[c];
+				}
+
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+
+				valid = mapped && glm::dot(before, after) > 0.0f;
+			}
+
+			if (!valid)
+				continue;
+
+			// The one-ring is frozen for the rest of the pass so the checks above stay valid
+			for (GLuint k = firstTriangle[from]; k < firstTriangle[from + 1]; k++)
+			{
+				const GLuint* triangle = &triangles[adjacency[k] * 3];
+
+				for (int c = 0; c < 3; c++)
+					touched[weld[triangle[c]]] = true;
+			}
+
+			for (const auto& pair : wedgeMap)
+				collapseTo[pair.first] = pair.second;
+
+			addQuadric(quadrics[to], quadrics[from]);
+			maxError = std::max(maxError, candidate.cost);
+			collapses++;
+		}
+
+		if (collapses == 0)
+			break;
+
+		// Remapping and dropping the triangles that became degenerate
+		size_t write = 0;
+
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			GLuint a = collapseTo[triangles[i]];
+			GLuint b = collapseTo[triangles[i + 1]];
+			GLuint c = collapseTo[triangles[i + 2]];
+
+			if (weld[a] == weld[b] || weld[b] == weld[c] || weld[c] == weld[a])
+				continue;
+
+			triangles[write++] = a;
+			triangles[write++] = b;
+			triangles[write++] = c;
+		}
+
+		triangles.resize(write);
+	}
+
+	std::copy(triangles.begin(), triangles.end(), destination);
+
+	if (resultError)
+		*resultError = (float)std::sqrt(maxError);
+
+	return triangles.size();
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+
+/// <summary>
+/// Quadric error simplification by edge collapse (Garland-Heckbert).
+/// Vertices only collapse onto existing vertices, so the output indexes the
+/// same vertex buffer. Vertices on open borders are kept in place, vertices
+/// on attribute seams (several vertices sharing one position) only collapse
+/// along the seam.
+/// positions points to the first vertex's xyz, stride is in floats.
+/// Returns the new index count written to destination (at most indexCount);
+/// resultError receives the largest collapse error in object-space units.
+/// </summary>
+size_t simplifyMesh(GLuint* destination,
+	const GLuint* indices,
+	size_t indexCount,
+	const GLfloat* positions,
+	size_t vertexCount,
+	size_t stride,
+	size_t targetIndexCount,
+	float* resultError);
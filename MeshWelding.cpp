@@ -0,0 +1,19 @@
+#include "MeshWelding.h"
+
+#include <unordered_map>
+
+size_t weldPositions(const GLfloat* positions, size_t stride, const GLuint* indices, size_t count, GLuint* welded)
+{
+	std::unordered_map<PositionKey, GLuint, PositionKeyHash> firstAtPosition;
+	firstAtPosition.reserve(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t vertex = indices != nullptr ? indices[i] : i;
+		PositionKey key;
+		std::memcpy(key.xyz, positions + vertex * stride, sizeof(key.xyz));
+		welded[i] = firstAtPosition.emplace(key, (GLuint)i).first->second;
+	}
+
+	return firstAtPosition.size();
+}
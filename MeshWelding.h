@@ -0,0 +1,37 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Exact xyz of a vertex, compared bit for bit: 0.0 and -0.0 stay apart,
+// a NaN matches the same NaN bits
+struct PositionKey
+{
+	float xyz[3];
+
+	bool operator==(const PositionKey& other) const
+	{
+		return std::memcmp(xyz, other.xyz, sizeof(xyz)) == 0;
+	}
+};
+
+struct PositionKeyHash
+{
+	size_t operator()(const PositionKey& key) const
+	{
+		uint32_t bits[3];
+		std::memcpy(bits, key.xyz, sizeof(bits));
+		return (size_t)bits[0] * 73856093u ^ (size_t)bits[1] * 19349663u ^ (size_t)bits[2] * 83492791u;
+	}
+};
+
+/// <summary>
+/// Welds vertices that only differ in normal or uv (seams) by their exact
+/// position. The vertices are indices[0..count), or 0..count when indices
+/// is null; welded[i] receives the first i at the same position as i, so
+/// every welded id is below count. Returns how many positions there are.
+/// positions points to the first vertex's xyz, stride is in floats.
+/// </summary>
+size_t weldPositions(const GLfloat* positions, size_t stride, const GLuint* indices, size_t count, GLuint* welded);
@@ -0,0 +1,352 @@
+#include "Meshlets.h"
+#include "MeshWelding.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+	// How much a triangle facing away from the cluster counts against it,
+	// in new vertices (a full 90 degree turn costs as much as CONE_WEIGHT vertices)
+	const float CONE_WEIGHT = 2.0f;
+
+	// Cones whose triangles spread wider than this (cosine) are never culled
+	const float MIN_CONE_SPREAD = 0.1f;
+
+	// Past MESHLET_MIN_TRIANGLES a cluster only takes triangles within this
+	// (cosine) of its average normal, and closes rather than widen its cone
+	const float CONE_LIMIT = 0.8f;
+
+	struct Cluster
+	{
+		std::vector<GLuint> triangles;
+		glm::vec3 normalSum;
+		glm::vec3 centroid; // area-weighted
+		float area;
+	};
+}
+
+void buildMeshlets(std::vector<Meshlet>& meshlets,
+	GLuint* indices,
+	size_t indexCount,
+	size_t indexBase,
+	const GLfloat* positions,
+	size_t stride,
+	bool outwardFirst)
+{
+	size_t triangleCount = indexCount / 3;
+
+	if (triangleCount == 0)
+		return;
+
+	auto position = [&](GLuint v)
+	{
+		return glm::make_vec3(positions + (size_t)v * stride);
+	};
+
+	// ---------------------------------------------------
+	// TRIANGLE NORMALS AND CENTROIDS
+	std::vector<glm::vec3> normals(triangleCount);
+	std::vector<glm::vec3> centroids(triangleCount);
+	std::vector<float> areas(triangleCount);
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		glm::vec3 a = position(indices[t * 3]);
+		glm::vec3 b = position(indices[t * 3 + 1]);
+		glm::vec3 c = position(indices[t * 3 + 2]);
+		glm::vec3 cross = glm::cross(b - a, c - a);
+		float length = glm::length(cross);
+
+		normals[t] = length > 0.0f ? cross / length : glm::vec3(0.0f);
+		centroids[t] = (a + b + c) / 3.0f;
+		areas[t] = length;
+	}
+
+	// ---------------------------------------------------
+	// WELDING
+	// Adjacency works on positions, so hard edges and uv seams do not split
+	// clusters; corner[i] is the welded vertex of index i, the first index
+	// at its position, so welded ids run up to the corner count
+	size_t cornerCount = triangleCount * 3;
+	std::vector<GLuint> corner(cornerCount);
+	weldPositions(positions, stride, indices, cornerCount, corner.data());
+
+	// ---------------------------------------------------
+	// VERTEX -> TRIANGLE ADJACENCY
+	std::vector<GLuint> firstTriangle(cornerCount + 1, 0);
+
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		firstTriangle[corner[i] + 1]++;
+
+	for (size_t v = 0; v < cornerCount; v++)
+		firstTriangle[v + 1] += firstTriangle[v];
+
+	std::vector<GLuint> adjacency(triangleCount * 3);
+	std::vector<GLuint> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		adjacency[cursor[corner[i]]++] = (GLuint)(i / 3);
+
+	// ---------------------------------------------------
+	// GREEDY CLUSTERING
+	// Clusters grow from the first unused triangle, always taking the
+	// neighbour that adds the fewest vertices and bends the cone the least
+	std::vector<Cluster> clusters;
+	std::vector<bool> used(triangleCount, false);
+	std::vector<uint32_t> vertexStamp(cornerCount, 0);
+	std::vector<uint32_t> candidateStamp(triangleCount, 0);
+	std::vector<GLuint> candidates;
+	size_t seed = 0;
+
+	while (true)
+	{
+		while (seed < triangleCount && used[seed])
+			seed++;
+
+		if (seed == triangleCount)
+			break;
+
+		uint32_t stamp = (uint32_t)clusters.size() + 1;
+		Cluster cluster = {{}, glm::vec3(0.0f), glm::vec3(0.0f), 0.0f};
+		candidates.clear();
+
+		auto add = [&](GLuint t)
+		{
+			used[t] = true;
+			cluster.triangles.push_back(t);
+			cluster.normalSum += normals[t];
+			cluster.centroid += centroids[t] * areas[t];
+			cluster.area += areas[t];
+
+			for (int c = 0; c < 3; c++)
+			{
+				GLuint v = corner[t * 3 + c];
+
+				if (vertexStamp[v] == stamp)
+					continue;
+
+				vertexStamp[v] = stamp;
+
+				for (GLuint k = firstTriangle[v]; k < firstTriangle[v + 1]; k++)
+				{
+					GLuint neighbour = adjacency[k];
+
+					if (!used[neighbour] && candidateStamp[neighbour] != stamp)
+					{
+						candidateStamp[neighbour] = stamp;
+						candidates.push_back(neighbour);
+					}
+				}
+			}
+		};
+
+		add((GLuint)seed);
+
+		while (cluster.triangles.size() < (size_t)MESHLET_MAX_TRIANGLES)
+		{
+			float length = glm::length(cluster.normalSum);
+			glm::vec3 direction = length > 0.0f ? cluster.normalSum / length : glm::vec3(0.0f);
+
+			long long best = -1;
+			float bestScore = 0.0f;
+			size_t write = 0;
+
+			for (GLuint t : candidates)
+			{
+				if (used[t])
+					continue;
+
+				candidates[write++] = t;
+
+				int newVertices = 0;
+
+				for (int c = 0; c < 3; c++)
+					newVertices += vertexStamp[corner[t * 3 + c]] != stamp;
+
+				float alignment = glm::dot(normals[t], direction);
+
+				if (cluster.triangles.size() >= (size_t)MESHLET_MIN_TRIANGLES && alignment < CONE_LIMIT)
+					continue;
+
+				float score = newVertices + CONE_WEIGHT * (1.0f - alignment);
+
+				if (best < 0 || score < bestScore)
+				{
+					best = t;
+					bestScore = score;
+				}
+			}
+
+			candidates.resize(write);
+
+			// Nothing connected is left, the cluster ends early
+			if (best < 0)
+				break;
+
+			add((GLuint)best);
+		}
+
+		if (cluster.area > 0.0f)
+			cluster.centroid /= cluster.area;
+
+		clusters.push_back(std::move(cluster));
+	}
+
+	// ---------------------------------------------------
+	// CLUSTER ORDER
+	std::vector<size_t> order(clusters.size());
+
+	for (size_t c = 0; c < clusters.size(); c++)
+		order[c] = c;
+
+	if (outwardFirst && clusters.size() > 1)
+	{
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+
+		for (const Cluster& cluster : clusters)
+		{
+			meshCentroid += cluster.centroid * cluster.area;
+			meshArea += cluster.area;
+		}
+
+		if (meshArea > 0.0f)
+			meshCentroid /= meshArea;
+
+		// Clusters facing away from the centre occlude the rest, so they go first
+		std::vector<float> sortKey(clusters.size());
+
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			float length = glm::length(clusters[c].normalSum);
+			sortKey[c] = length > 0.0f ? glm::dot(clusters[c].centroid - meshCentroid, clusters[c].normalSum / length) : 0.0f;
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y)
+			{ return sortKey[x] > sortKey[y]; });
+	}
+
+	// ---------------------------------------------------
+	// OUTPUT
+	std::vector<GLuint> output;
+	output.reserve(triangleCount * 3);
+
+	for (size_t c : order)
+	{
+		Cluster& cluster = clusters[c];
+
+		// Keeping the incoming (vertex cache optimized) order inside the cluster
+		std::sort(cluster.triangles.begin(), cluster.triangles.end());
+
+		Meshlet meshlet = {};
+		meshlet.indexOffset = (uint32_t)(indexBase + output.size());
+		meshlet.indexCount = (uint32_t)(cluster.triangles.size() * 3);
+
+		// Bounding sphere around the centre of the cluster's box
+		glm::vec3 boxMin = position(indices[cluster.triangles[0] * 3]);
+		glm::vec3 boxMax = boxMin;
+
+		for (GLuint t : cluster.triangles)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				boxMin = glm::min(boxMin, position(indices[t * 3 + k]));
+				boxMax = glm::max(boxMax, position(indices[t * 3 + k]));
+			}
+		}
+
+		glm::vec3 center = (boxMin + boxMax) * 0.5f;
+		float radius = 0.0f;
+
+		for (GLuint t : cluster.triangles)
+		{
+			for (int k = 0; k < 3; k++)
+				radius = std::max(radius, glm::length(position(indices[t * 3 + k]) - center));
+
+			output.insert(output.end(), indices + t * 3, indices + t * 3 + 3);
+		}
+
+		// Normal cone: the average direction and the widest triangle around it
+		float length = glm::length(cluster.normalSum);
+		glm::vec3 axis = length > 0.0f ? cluster.normalSum / length : glm::vec3(0.0f);
+		float minDot = 1.0f;
+
+		for (GLuint t : cluster.triangles)
+		{
+			if (areas[t] > 0.0f)
+				minDot = std::min(minDot, glm::dot(normals[t], axis));
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			meshlet.center[k] = center[k];
+			meshlet.coneAxis[k] = axis[k];
+		}
+
+		meshlet.radius = radius;
+		meshlet.coneCutoff = length > 0.0f && minDot > MIN_CONE_SPREAD ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+
+		meshlets.push_back(meshlet);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+MeshletCuller::MeshletCuller(const glm::mat4& transform, const glm::mat4& projection, const glm::mat4& view)
+{
+	// Frustum planes straight from the rows of the object-to-clip matrix (Gribb-Hartmann)
+	glm::mat4 rows = glm::transpose(projection * view * transform);
+
+	this->planes[0] = rows[3] + rows[0];
+	this->planes[1] = rows[3] - rows[0];
+	this->planes[2] = rows[3] + rows[1];
+	this->planes[3] = rows[3] - rows[1];
+	this->planes[4] = rows[3] + rows[2];
+	this->planes[5] = rows[3] - rows[2];
+
+	for (glm::vec4& plane : this->planes)
+	{
+		float length = glm::length(glm::vec3(plane));
+
+		if (length > 0.0f)
+			plane /= length;
+	}
+
+	// Perspective matrices put -z into w, orthographic ones leave it out
+	glm::mat4 toObject = glm::inverse(view * transform);
+	this->orthographic = projection[2][3] == 0.0f;
+
+	if (this->orthographic)
+		this->eye = glm::normalize(glm::vec3(toObject * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+	else
+		this->eye = glm::vec3(toObject * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+bool MeshletCuller::isVisible(const Meshlet& meshlet) const
+{
+	glm::vec3 center = glm::make_vec3(meshlet.center);
+
+	for (const glm::vec4& plane : this->planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -meshlet.radius)
+			return false;
+	}
+
+	if (meshlet.coneCutoff >= 1.0f)
+		return true;
+
+	// Back-facing when every view ray into the sphere stays inside the cone's
+	// back half (meshoptimizer's cone test)
+	glm::vec3 axis = glm::make_vec3(meshlet.coneAxis);
+
+	if (this->orthographic)
+		return glm::dot(this->eye, axis) < meshlet.coneCutoff;
+
+	glm::vec3 offset = center - this->eye;
+	return glm::dot(offset, axis) < meshlet.coneCutoff * glm::length(offset) + meshlet.radius;
+}
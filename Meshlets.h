@@ -0,0 +1,49 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "MeshCache.h"
+
+#include <cstddef>
+#include <vector>
+
+// Triangles per cluster, small enough for the cone to stay narrow on curved hulls.
+// Clusters stop growing early (from the minimum on) when their cone gets too wide.
+const int MESHLET_MIN_TRIANGLES = 64;
+const int MESHLET_MAX_TRIANGLES = 128;
+
+/// <summary>
+/// Splits one index range (a submesh) into clusters of adjacent, similarly
+/// facing triangles and rewrites the range cluster by cluster, each cluster
+/// in vertex cache order. Appends one Meshlet per cluster with a bounding
+/// sphere and a normal cone; indexBase is added to their index offsets.
+/// outwardFirst sorts clusters facing away from the centre to the front
+/// (the overdraw ordering of MeshOptimizer, done per cluster).
+/// positions points to the first vertex's xyz, stride is in floats.
+/// </summary>
+void buildMeshlets(std::vector<Meshlet>& meshlets,
+	GLuint* indices,
+	size_t indexCount,
+	size_t indexBase,
+	const GLfloat* positions,
+	size_t stride,
+	bool outwardFirst);
+
+/// <summary>
+/// Frustum planes and view point of one draw, moved into the mesh's object
+/// space so meshlet bounds can be tested without transforming them.
+/// </summary>
+class MeshletCuller
+{
+private:
+	glm::vec4 planes[6];
+	// Camera position for perspective projections, view direction for orthographic ones
+	glm::vec3 eye;
+	bool orthographic;
+
+public:
+	MeshletCuller(const glm::mat4& transform, const glm::mat4& projection, const glm::mat4& view);
+
+	// False when the cluster is outside the frustum or all its triangles face away
+	bool isVisible(const Meshlet& meshlet) const;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cstddef>
+
+/// <summary>
+/// Mip levels of one GL texture that can be given storage, filled and
+/// released a level at a time, so the texture streamer can fill them in
+/// coarsest first and drop the finest ones again under memory pressure.
+/// Every call works on the texture bound to target() on the GL thread.
+/// </summary>
+class MipSource
+{
+public:
+	virtual ~MipSource() = default;
+
+	virtual GLenum target() const = 0;
+	virtual int levelCount() const = 0;
+	// Longer side of level 0, in texels
+	virtual int size() const = 0;
+	// Estimated GPU memory of one level
+	virtual size_t levelBytes(int level) const = 0;
+
+	// Gives one level its storage, leaving it empty
+	virtual void allocateLevel(int level) = 0;
+	// Fills one allocated level
+	virtual void uploadLevel(int level) = 0;
+	// Frees one level's storage (respecifies it as 0x0)
+	virtual void releaseLevel(int level) = 0;
+};
+
+// GPU bytes per texel of an uncompressed internal format; drivers pad
+// three-channel formats to four
+inline size_t texelBytes(GLint internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_RED:
+	case GL_R8:
+		return 1;
+	case GL_RG:
+	case GL_RG8:
+		return 2;
+	default:
+		return 4;
+	}
+}
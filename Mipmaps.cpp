@@ -0,0 +1,463 @@
+#include "Mipmaps.h"
+#include "Jobs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Output rows per job
+	const int ROWS_PER_JOB = 32;
+
+	// Kaiser window: half-width in destination texels, and shape
+	const float KAISER_WIDTH = 1.5f;
+	const float KAISER_ALPHA = 4.0f;
+
+	// Linear values are encoded back to sRGB through a table this fine
+	const int LINEAR_STEPS = 16384;
+
+	const float PI = 3.14159265358979f;
+
+	struct SrgbTables
+	{
+		float toLinear[256];
+		unsigned char fromLinear[LINEAR_STEPS + 1];
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+
+			for (int i = 0; i <= LINEAR_STEPS; i++)
+			{
+				float l = (float)i / LINEAR_STEPS;
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				fromLinear[i] = (unsigned char)(c * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	const SrgbTables& srgbTables()
+	{
+		static const SrgbTables tables;
+		return tables;
+	}
+
+	// Alpha of grey + alpha and RGBA images, the rest is colour
+	bool isAlpha(int channels, int c)
+	{
+		return (channels == 4 && c == 3) || (channels == 2 && c == 1);
+	}
+
+	// Runs rows(first, last) over bands of the rows, across the workers
+	void forRowBands(int rowCount, const std::function<void(int, int)>& rows)
+	{
+		size_t bands = (size_t)(rowCount + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+
+		parallelFor(bands, [&](size_t band)
+			{
+				int first = (int)band * ROWS_PER_JOB;
+				rows(first, std::min(first + ROWS_PER_JOB, rowCount));
+			});
+	}
+
+	// ---------------------------------------------------
+	// BOX FILTER (8-BIT)
+	// Sums each row pair into 16 bits, then halves the row
+	void boxRows(const unsigned char* source, int sourceWidth, int sourceHeight, int channels,
+		MipLevel& level, int firstRow, int lastRow)
+	{
+		// Sides already at 1 texel read the same row or column twice
+		int stepX = sourceWidth > 1 ? 1 : 0;
+		int stepY = sourceHeight > 1 ? 1 : 0;
+		size_t rowBytes = (size_t)sourceWidth * channels;
+		std::vector<uint16_t> sums(rowBytes);
+
+		for (int y = firstRow; y < lastRow; y++)
+		{
+			const unsigned char* row0 = source + (size_t)(y * 2) * rowBytes;
+			const unsigned char* row1 = source + (size_t)(y * 2 + stepY) * rowBytes;
+			unsigned char* out = level.pixels.data() + (size_t)y * level.width * channels;
+			size_t i = 0;
+
+#ifdef USE_SSE2
+			const __m128i zero = _mm_setzero_si128();
+
+			for (; i + 16 <= rowBytes; i += 16)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(row0 + i));
+				__m128i b = _mm_loadu_si128((const __m128i*)(row1 + i));
+
+				_mm_storeu_si128((__m128i*)(sums.data() + i),
+					_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+				_mm_storeu_si128((__m128i*)(sums.data() + i + 8),
+					_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+			}
+#endif
+
+			for (; i < rowBytes; i++)
+				sums[i] = (uint16_t)(row0[i] + row1[i]);
+
+			int x = 0;
+
+#ifdef USE_SSE2
+			// RGBA: one source pixel pair is 8 sums, two output pixels per step
+			if (channels == 4 && stepX == 1)
+			{
+				const __m128i two = _mm_set1_epi16(2);
+
+				for (; x + 2 <= level.width; x += 2)
+				{
+					__m128i p0 = _mm_loadu_si128((const __m128i*)(sums.data() + (size_t)x * 8));
+					__m128i p1 = _mm_loadu_si128((const __m128i*)(sums.data() + (size_t)x * 8 + 8));
+					__m128i total = _mm_add_epi16(_mm_unpacklo_epi64(p0, p1), _mm_unpackhi_epi64(p0, p1));
+					total = _mm_srli_epi16(_mm_add_epi16(total, two), 2);
+
+					_mm_storel_epi64((__m128i*)(out + (size_t)x * 4), _mm_packus_epi16(total, zero));
+				}
+			}
+#endif
+
+			for (; x < level.width; x++)
+			{
+				size_t left = (size_t)(x * 2) * channels;
+				size_t right = (size_t)(x * 2 + stepX) * channels;
+
+				for (int c = 0; c < channels; c++)
+					out[x * channels + c] = (unsigned char)((sums[left + c] + sums[right + c] + 2) / 4);
+			}
+		}
+	}
+
+	// ---------------------------------------------------
+	// SEPARABLE FILTERS (FLOAT)
+	// Source texels and weights of every output texel along one axis
+	struct AxisTaps
+	{
+		int count;
+		std::vector<int> index;
+		std::vector<float> weight;
+	};
+
+	float kaiserWindow(float x)
+	{
+		// Modified Bessel function of the first kind, order 0 (power series)
+		auto bessel0 = [](float v)
+		{
+			float sum = 1.0f, term = 1.0f;
+
+			for (int k = 1; k < 16; k++)
+			{
+				term *= (v / (2.0f * k)) * (v / (2.0f * k));
+				sum += term;
+			}
+
+			return sum;
+		};
+
+		return std::fabs(x) >= 1.0f ? 0.0f : bessel0(KAISER_ALPHA * std::sqrt(1.0f - x * x)) / bessel0(KAISER_ALPHA);
+	}
+
+	AxisTaps axisTaps(int sourceSize, int size, MipFilter filter)
+	{
+		AxisTaps taps;
+
+		if (filter == MipFilter::Box)
+		{
+			taps.count = 2;
+
+			for (int x = 0; x < size; x++)
+			{
+				taps.index.push_back(x * 2);
+				taps.index.push_back(std::min(x * 2 + 1, sourceSize - 1));
+				taps.weight.push_back(0.5f);
+				taps.weight.push_back(0.5f);
+			}
+
+			return taps;
+		}
+
+		float scale = (float)sourceSize / size;
+		float radius = KAISER_WIDTH * scale;
+		taps.count = (int)std::ceil(radius * 2.0f) + 1;
+
+		for (int x = 0; x < size; x++)
+		{
+			float center = (x + 0.5f) * scale;
+			int first = (int)std::floor(center - radius);
+			float total = 0.0f;
+
+			for (int t = 0; t < taps.count; t++)
+			{
+				// Distance in output texels, sinc cut off at the output's Nyquist rate
+				float u = (first + t + 0.5f - center) / scale;
+				float sinc = u == 0.0f ? 1.0f : std::sin(PI * u) / (PI * u);
+				float w = sinc * kaiserWindow(u / KAISER_WIDTH);
+
+				// Clamped to the edge
+				taps.index.push_back(std::min(std::max(first + t, 0), sourceSize - 1));
+				taps.weight.push_back(w);
+				total += w;
+			}
+
+			for (int t = 0; t < taps.count; t++)
+				taps.weight[(size_t)x * taps.count + t] /= total;
+		}
+
+		return taps;
+	}
+
+	void filterLevel(const unsigned char* source, int sourceWidth, int sourceHeight, int channels,
+		MipLevel& level, const MipOptions& options)
+	{
+		const SrgbTables& tables = srgbTables();
+		AxisTaps tapsX = axisTaps(sourceWidth, level.width, options.filter);
+		AxisTaps tapsY = axisTaps(sourceHeight, level.height, options.filter);
+
+		// Texel to linear float, and back
+		float toLinear[4][256];
+
+		for (int c = 0; c < channels; c++)
+		{
+			for (int i = 0; i < 256; i++)
+				toLinear[c][i] = options.srgb && !isAlpha(channels, c) ? tables.toLinear[i] : i / 255.0f;
+		}
+
+		auto encode = [&](float value, int c)
+		{
+			value = std::min(std::max(value, 0.0f), 1.0f);
+
+			if (options.srgb && !isAlpha(channels, c))
+				return tables.fromLinear[(int)(value * LINEAR_STEPS + 0.5f)];
+
+			return (unsigned char)(value * 255.0f + 0.5f);
+		};
+
+		// Horizontal pass over every source row, then vertical into the level.
+		// Rows carry one float of padding so RGB texels can be read and
+		// written four floats at a time, the fourth overwritten by the next texel.
+		size_t rowFloats = (size_t)level.width * channels;
+		std::vector<float> horizontal((rowFloats + 1) * sourceHeight);
+
+		forRowBands(sourceHeight, [&](int first, int last)
+			{
+				std::vector<float> linear((size_t)sourceWidth * channels + 1, 0.0f);
+
+				for (int y = first; y < last; y++)
+				{
+					const unsigned char* row = source + (size_t)y * sourceWidth * channels;
+					float* out = horizontal.data() + (size_t)y * (rowFloats + 1);
+
+					for (int x = 0; x < sourceWidth; x++)
+					{
+						for (int c = 0; c < channels; c++)
+							linear[(size_t)x * channels + c] = toLinear[c][row[(size_t)x * channels + c]];
+					}
+
+					for (int x = 0; x < level.width; x++)
+					{
+						const int* index = tapsX.index.data() + (size_t)x * tapsX.count;
+						const float* weight = tapsX.weight.data() + (size_t)x * tapsX.count;
+
+#ifdef USE_SSE2
+						if (channels >= 3)
+						{
+							__m128 sum = _mm_setzero_ps();
+
+							for (int t = 0; t < tapsX.count; t++)
+								sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&linear[(size_t)index[t] * channels]), _mm_set1_ps(weight[t])));
+
+							_mm_storeu_ps(out + (size_t)x * channels, sum);
+							continue;
+						}
+#endif
+
+						for (int c = 0; c < channels; c++)
+						{
+							float sum = 0.0f;
+
+							for (int t = 0; t < tapsX.count; t++)
+								sum += linear[(size_t)index[t] * channels + c] * weight[t];
+
+							out[x * channels + c] = sum;
+						}
+					}
+				}
+			});
+
+		forRowBands(level.height, [&](int first, int last)
+			{
+				std::vector<float> sums(rowFloats);
+
+				for (int y = first; y < last; y++)
+				{
+					const int* index = tapsY.index.data() + (size_t)y * tapsY.count;
+					const float* weight = tapsY.weight.data() + (size_t)y * tapsY.count;
+					unsigned char* out = level.pixels.data() + (size_t)y * rowFloats;
+
+					std::fill(sums.begin(), sums.end(), 0.0f);
+
+					for (int t = 0; t < tapsY.count; t++)
+					{
+						const float* row = horizontal.data() + (size_t)index[t] * (rowFloats + 1);
+						size_t i = 0;
+
+#ifdef USE_SSE2
+						__m128 w = _mm_set1_ps(weight[t]);
+
+						for (; i + 4 <= rowFloats; i += 4)
+							_mm_storeu_ps(&sums[i], _mm_add_ps(_mm_loadu_ps(&sums[i]), _mm_mul_ps(_mm_loadu_ps(row + i), w)));
+#endif
+
+						for (; i < rowFloats; i++)
+							sums[i] += row[i] * weight[t];
+					}
+
+					for (int x = 0; x < level.width; x++)
+					{
+						for (int c = 0; c < channels; c++)
+							out[x * channels + c] = encode(sums[(size_t)x * channels + c], c);
+					}
+				}
+			});
+	}
+
+	// ---------------------------------------------------
+	// ALPHA COVERAGE
+	// Share of texels whose alpha, times scale, reaches cutoff (0..255)
+	float alphaCoverage(const unsigned char* pixels, size_t texels, int channels, float scale, float cutoff)
+	{
+		size_t covered = 0;
+
+		for (size_t i = 0; i < texels; i++)
+			covered += pixels[i * channels + channels - 1] * scale >= cutoff;
+
+		return texels == 0 ? 0.0f : (float)covered / texels;
+	}
+
+	void preserveCoverage(MipLevel& level, int channels, float coverage, float cutoff)
+	{
+		size_t texels = (size_t)level.width * level.height;
+		float low = 0.0f, high = 4.0f;
+
+		// Already on target, as on opaque images (the bisection would halve their alpha)
+		if (alphaCoverage(level.pixels.data(), texels, channels, 1.0f, cutoff) == coverage)
+			return;
+
+		// Coverage only grows with the scale, so a bisection finds it
+		for (int i = 0; i < 16; i++)
+		{
+			float middle = (low + high) * 0.5f;
+
+			if (alphaCoverage(level.pixels.data(), texels, channels, middle, cutoff) < coverage)
+				low = middle;
+			else
+				high = middle;
+		}
+
+		// Coverage moves in steps, the side of the step closer to the target wins
+		float below = alphaCoverage(level.pixels.data(), texels, channels, low, cutoff);
+		float above = alphaCoverage(level.pixels.data(), texels, channels, high, cutoff);
+		float scale = coverage - below < above - coverage ? low : high;
+
+		for (size_t i = 0; i < texels; i++)
+		{
+			unsigned char& alpha = level.pixels[i * channels + channels - 1];
+			alpha = (unsigned char)std::min(alpha * scale + 0.5f, 255.0f);
+		}
+	}
+}
+
+void buildMipChain(const unsigned char* pixels, int width, int height, int channels,
+	std::vector<MipLevel>& levels, const MipOptions& options)
+{
+	levels.clear();
+
+	const unsigned char* source = pixels;
+	int sourceWidth = width;
+	int sourceHeight = height;
+
+	bool coverage = options.preserveCoverage && (channels == 2 || channels == 4);
+	float cutoff = options.alphaCutoff * 255.0f;
+	float baseCoverage = coverage ? alphaCoverage(pixels, (size_t)width * height, channels, 1.0f, cutoff) : 0.0f;
+
+	while (sourceWidth > 1 || sourceHeight > 1)
+	{
+		MipLevel level;
+		level.width = std::max(1, sourceWidth / 2);
+		level.height = std::max(1, sourceHeight / 2);
+		level.pixels.resize((size_t)level.width * level.height * channels);
+
+		if (options.filter == MipFilter::Box && !options.srgb)
+		{
+			forRowBands(level.height, [&](int first, int last)
+				{ boxRows(source, sourceWidth, sourceHeight, channels, level, first, last); });
+		}
+		else
+		{
+			filterLevel(source, sourceWidth, sourceHeight, channels, level, options);
+		}
+
+		if (coverage)
+			preserveCoverage(level, channels, baseCoverage, cutoff);
+
+		levels.push_back(std::move(level));
+
+		source = levels.back().pixels.data();
+		sourceWidth = levels.back().width;
+		sourceHeight = levels.back().height;
+	}
+}
+
+void resampleImage(const unsigned char* pixels, int width, int height, int channels,
+	unsigned char* resampled, int resampledWidth, int resampledHeight)
+{
+	float scaleX = (float)width / resampledWidth;
+	float scaleY = (float)height / resampledHeight;
+
+	// Source columns and weights are the same on every row
+	std::vector<int> left(resampledWidth), right(resampledWidth);
+	std::vector<float> weightX(resampledWidth);
+
+	for (int x = 0; x < resampledWidth; x++)
+	{
+		float sourceX = std::max((x + 0.5f) * scaleX - 0.5f, 0.0f);
+		left[x] = std::min((int)sourceX, width - 1);
+		right[x] = std::min(left[x] + 1, width - 1);
+		weightX[x] = sourceX - left[x];
+	}
+
+	for (int y = 0; y < resampledHeight; y++)
+	{
+		float sourceY = std::max((y + 0.5f) * scaleY - 0.5f, 0.0f);
+		int top = std::min((int)sourceY, height - 1);
+		int bottom = std::min(top + 1, height - 1);
+		float weightY = sourceY - top;
+
+		const unsigned char* row0 = pixels + (size_t)top * width * channels;
+		const unsigned char* row1 = pixels + (size_t)bottom * width * channels;
+		unsigned char* out = resampled + (size_t)y * resampledWidth * channels;
+
+		for (int x = 0; x < resampledWidth; x++)
+		{
+			size_t l = (size_t)left[x] * channels;
+			size_t r = (size_t)right[x] * channels;
+
+			for (int c = 0; c < channels; c++)
+			{
+				float upper = row0[l + c] + (row0[r + c] - row0[l + c]) * weightX[x];
+				float lower = row1[l + c] + (row1[r + c] - row1[l + c]) * weightX[x];
+				out[x * channels + c] = (unsigned char)(upper + (lower - upper) * weightY + 0.5f);
+			}
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+
+// One level below the base image, tightly packed rows
+struct MipLevel
+{
+	int width;
+	int height;
+	std::vector<unsigned char> pixels;
+};
+
+enum class MipFilter
+{
+	// Each texel averages the 2x2 block above it, like glGenerateMipmap
+	Box,
+	// Kaiser-windowed sinc over 6x6 texels above: sharper, without the box's aliasing
+	Kaiser
+};
+
+struct MipOptions
+{
+	MipFilter filter = MipFilter::Box;
+	// Filters colour in linear light, for sRGB-encoded images (alpha is always linear)
+	bool srgb = false;
+	// Scales each level's alpha so the share of texels at or above alphaCutoff
+	// stays that of the base image, for alpha-tested textures
+	bool preserveCoverage = false;
+	float alphaCutoff = 0.5f;
+};
+
+/// <summary>
+/// Builds every level below an 8-bit image down to 1x1, with the sizes
+/// glGenerateMipmap uses (each side halved and rounded down, at least 1).
+/// Each level is filtered from the one above it, rows split across the
+/// worker threads (serially when called from a job). The plain box filter
+/// runs on SSE2 where available.
+/// </summary>
+void buildMipChain(const unsigned char* pixels, int width, int height, int channels,
+	std::vector<MipLevel>& levels, const MipOptions& options = MipOptions());
+
+/// <summary>
+/// Bilinearly resamples an 8-bit image to another size, sampling at texel
+/// centres with edges clamped. Meant for mild size changes: shrinking by
+/// more than half skips source texels, so build a mip chain first for that.
+/// </summary>
+void resampleImage(const unsigned char* pixels, int width, int height, int channels,
+	unsigned char* resampled, int resampledWidth, int resampledHeight);
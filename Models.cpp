@@ -4,256 +4,1719 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include "AssetPack.h"
+#include "BatchReader.h"
+#include "Jobs.h"
+#include "ObjReader.h"
+#include "Tangents.h"
+#include "TextureStreaming.h"
+#include "TextureUploads.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <glm/gtc/packing.hpp>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
-void ModelClass::loadObj()
+namespace
 {
-    // Loading .obj file
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warning, error;
-    tinyobj::attrib_t attributes;
-
-    bool success = tinyobj::LoadObj(
-        &attributes,
-        &shapes,
-        &materials,
-        &warning,
-        &error,
-        this->objPath.c_str());
+    // Position, normal and texture coordinates, used to find corners shared between faces
+    struct VertexKey
+    {
+        GLfloat data[8];
 
-    // Loading tangents and bitangents
-    std::vector<glm::vec3> tangents;
-    std::vector<glm::vec3> bitangents;
+        bool operator==(const VertexKey &other) const
+        {
+            return std::memcmp(data, other.data, sizeof(data)) == 0;
+        }
+    };
 
-    for (int i = 0; i < shapes[0].mesh.indices.size(); i += 3)
+    // FNV-1a over the raw bytes of the vertex
+    struct VertexKeyHash
     {
-        tinyobj::index_t vData1 = shapes[0].mesh.indices[i];
-        tinyobj::index_t vData2 = shapes[0].mesh.indices[i + 1];
-        tinyobj::index_t vData3 = shapes[0].mesh.indices[i + 2];
+        size_t operator()(const VertexKey &key) const
+        {
+            const unsigned char *bytes = (const unsigned char *)key.data;
+            size_t hash = 14695981039346656037ULL;
 
-        glm::vec3 v1 = glm::vec3(
-            attributes.vertices[vData1.vertex_index * 3],
-            attributes.vertices[vData1.vertex_index * 3 + 1],
-            attributes.vertices[vData1.vertex_index * 3 + 2]);
+            for (size_t i = 0; i < sizeof(key.data); i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
 
-        glm::vec3 v2 = glm::vec3(
-            attributes.vertices[vData2.vertex_index * 3],
-            attributes.vertices[vData2.vertex_index * 3 + 1],
-            attributes.vertices[vData2.vertex_index * 3 + 2]);
+            return hash;
+        }
+    };
+}
 
-        glm::vec3 v3 = glm::vec3(
-            attributes.vertices[vData3.vertex_index * 3],
-            attributes.vertices[vData3.vertex_index * 3 + 1],
-            attributes.vertices[vData3.vertex_index * 3 + 2]);
+void ModelClass::registerMesh()
+{
+    if (this->meshRegistered)
+        return;
 
-        glm::vec2 uv1 = glm::vec2(
-            attributes.texcoords[vData1.texcoord_index * 2],
-            attributes.texcoords[vData1.texcoord_index * 2 + 1]);
+    // Sharing the mesh with any model that loaded (or is loading) the same
+    // file, only the first one to register it does the work
+    MeshHandle shared = AssetRegistry::addMesh(getMeshKey(), this->mesh);
+    this->ownsMeshData = shared == this->mesh;
+    this->mesh = shared;
+    this->meshRegistered = true;
+}
 
-        glm::vec2 uv2 = glm::vec2(
-            attributes.texcoords[vData2.texcoord_index * 2],
-            attributes.texcoords[vData2.texcoord_index * 2 + 1]);
+void ModelClass::loadObj()
+{
+    // Called on its own, there is no other thread to race with
+    registerMesh();
 
-        glm::vec2 uv3 = glm::vec2(
-            attributes.texcoords[vData3.texcoord_index * 2],
-            attributes.texcoords[vData3.texcoord_index * 2 + 1]);
+    if (!this->ownsMeshData)
+        return;
 
-        glm::vec3 deltaPos1 = v2 - v1;
-        glm::vec3 deltaPos2 = v3 - v1;
+    // Reusing the precooked mesh if the .obj and the load options have not
+    // changed since it was written
+    uint64_t sourceHash = hashAsset(this->objPath);
 
-        glm::vec2 deltaUV1 = uv2 - uv1;
-        glm::vec2 deltaUV2 = uv3 - uv1;
+    if (sourceHash != 0)
+    {
+        sourceHash = hashBytes(&this->overdrawOrdering, sizeof(this->overdrawOrdering), sourceHash);
+        sourceHash = hashBytes(&this->meshletCulling, sizeof(this->meshletCulling), sourceHash);
+    }
+
+    PhaseTimer cacheTimer(this->objPath, "cache load");
+
+    if (loadCache(sourceHash))
+        return;
 
-        float r = 1.0f / ((deltaUV1.x * deltaUV2.y) - (deltaUV1.y * deltaUV2.x));
+    cacheTimer.stop();
 
-        glm::vec3 tangent = r * (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y);
-        glm::vec3 bitangent = r * (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x);
+    // Loading .obj file (materials are looked up next to it)
+    ObjData obj;
+    std::string error;
+    PhaseTimer parseTimer(this->objPath, "parse");
 
-        tangents.push_back(tangent);
-        tangents.push_back(tangent);
-        tangents.push_back(tangent);
+    bool parsed = readObj(this->objPath, obj, error);
+    parseTimer.stop();
 
-        bitangents.push_back(bitangent);
-        bitangents.push_back(bitangent);
-        bitangents.push_back(bitangent);
+    if (!parsed)
+    {
+        std::cout << "Failed to load " << this->objPath << ": " << error << "\n";
+        return;
     }
 
+    // Corners are triangulated and already packed in submesh (material) order
+    const std::vector<ObjCorner> &corners = obj.corners;
+    this->mesh->submeshes = obj.submeshes;
+    this->mesh->materialTexturePaths = obj.materialTextures;
+
+    // Attribute lookups, missing normals or texture coordinates read as zero
+    auto position = [&](const ObjCorner &corner)
+    {
+        return glm::make_vec3(&obj.positions[corner.position * 3]);
+    };
+
+    auto normal = [&](const ObjCorner &corner)
+    {
+        return corner.normal < 0 ? glm::vec3(0.0f) : glm::make_vec3(&obj.normals[corner.normal * 3]);
+    };
+
+    auto texCoord = [&](const ObjCorner &corner)
+    {
+        return corner.texcoord < 0 ? glm::vec2(0.0f) : glm::make_vec2(&obj.texcoords[corner.texcoord * 2]);
+    };
+
     // Loading vertex data
-    for (int i = 0; i < shapes[0].mesh.indices.size(); i++)
+    // Corners with the same position, normal and texture coordinates are merged
+    // into a single vertex and referenced through the index buffer.
+    PhaseTimer assemblyTimer(this->objPath, "vertex assembly");
+    std::unordered_map<VertexKey, GLuint, VertexKeyHash> uniqueVertices;
+    uniqueVertices.reserve(corners.size());
+
+    this->vertexData.clear();
+    this->indexData.clear();
+    this->indexData.reserve(corners.size());
+
+    for (size_t i = 0; i < corners.size(); i++)
     {
-        tinyobj::index_t vData = shapes[0].mesh.indices[i];
-        int vertexIndex = vData.vertex_index * 3;
-        int normalIndex = vData.normal_index * 3;
-        int uvIndex = vData.texcoord_index * 2;
+        glm::vec3 p = position(corners[i]);
+        glm::vec3 n = normal(corners[i]);
+        glm::vec2 uv = texCoord(corners[i]);
+
+        GLfloat vertex[FLOATS_PER_VERTEX] = {};
 
         // ---------------------------------------------------
         // POSITION
-        this->vertexData.push_back(
-            attributes.vertices[vertexIndex]);
-
-        this->vertexData.push_back(
-            attributes.vertices[vertexIndex + 1]);
-
-        this->vertexData.push_back(
-            attributes.vertices[vertexIndex + 2]);
+        vertex[0] = p.x;
+        vertex[1] = p.y;
+        vertex[2] = p.z;
 
         // ---------------------------------------------------
         // NORMALS
-        this->vertexData.push_back(
-            attributes.normals[normalIndex]);
+        vertex[3] = n.x;
+        vertex[4] = n.y;
+        vertex[5] = n.z;
 
-        this->vertexData.push_back(
-            attributes.normals[normalIndex + 1]);
+        // ---------------------------------------------------
+        // TEXTURE COORDINATES
+        vertex[6] = uv.x;
+        vertex[7] = uv.y;
 
-        this->vertexData.push_back(
-            attributes.normals[normalIndex + 2]);
+        // Tangents are filled in below, once all faces are known
+        VertexKey key;
+        std::memcpy(key.data, vertex, sizeof(key.data));
+
+        auto found = uniqueVertices.find(key);
+
+        if (found != uniqueVertices.end())
+        {
+            this->indexData.push_back(found->second);
+            continue;
+        }
+
+        GLuint index = (GLuint)(this->vertexData.size() / FLOATS_PER_VERTEX);
+        uniqueVertices.emplace(key, index);
+
+        this->vertexData.insert(
+            this->vertexData.end(),
+            vertex,
+            vertex + FLOATS_PER_VERTEX);
+        this->indexData.push_back(index);
+    }
+
+    assemblyTimer.stop();
+
+    // ---------------------------------------------------
+    // BOUNDS
+    // Known from here on, so a streamed model's placeholder can show up
+    // while the slower passes below run
+    if (!this->vertexData.empty())
+    {
+        this->mesh->boundsMin = glm::vec3(this->vertexData[0], this->vertexData[1], this->vertexData[2]);
+        this->mesh->boundsMax = this->mesh->boundsMin;
+    }
+
+    for (size_t i = 0; i < this->vertexData.size(); i += FLOATS_PER_VERTEX)
+    {
+        glm::vec3 position(this->vertexData[i], this->vertexData[i + 1], this->vertexData[i + 2]);
+        this->mesh->boundsMin = glm::min(this->mesh->boundsMin, position);
+        this->mesh->boundsMax = glm::max(this->mesh->boundsMax, position);
+    }
+
+    this->mesh->boundsReady = true;
+
+    // ---------------------------------------------------
+    // TANGENTS
+    // Smoothed per unique vertex, with the bitangent stored as a sign
+    PhaseTimer tangentTimer(this->objPath, "tangents");
+    generateTangents(
+        this->vertexData.data(),
+        this->vertexData.size() / FLOATS_PER_VERTEX,
+        this->indexData.data(),
+        this->indexData.size(),
+        {FLOATS_PER_VERTEX, 3, 6, 8});
+    tangentTimer.stop();
+
+    // ---------------------------------------------------
+    // DETAIL LEVELS
+    PhaseTimer lodTimer(this->objPath, "lods");
+    buildLods();
+    lodTimer.stop();
+
+    // ---------------------------------------------------
+    // TRIANGLE AND VERTEX ORDER
+    PhaseTimer optimizeTimer(this->objPath, "optimize");
+    optimizeMesh();
+    optimizeTimer.stop();
+
+    // ---------------------------------------------------
+    // LAYOUT
+    this->layout = {
+        {0, 3, GL_FLOAT, GL_FALSE, 0},                 // Vertices
+        {1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat)}, // Normals
+        {2, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat)}, // Texture coordinates
+        {3, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat)}, // Tangents + handedness
+    };
+    this->mesh->vertexStride = FLOATS_PER_VERTEX * sizeof(GLfloat);
+    this->mesh->packedVertices = false;
+    this->mesh->vertexCount = (GLsizei)(this->vertexData.size() / FLOATS_PER_VERTEX);
+    this->mesh->indexCount = (GLsizei)this->indexData.size();
+
+    if (this->packedVertices)
+        packVertices();
+
+    PhaseTimer writeTimer(this->objPath, "cache write");
+    writeCache(sourceHash);
+}
+
+void ModelClass::buildLods()
+{
+    size_t vertexTotal = this->vertexData.size() / FLOATS_PER_VERTEX;
+
+    // Level 0 is the mesh as loaded
+    this->mesh->lods = {{0, (uint32_t)this->mesh->submeshes.size(), 0.0f}};
+
+    for (int level = 1; level < MAX_LODS; level++)
+    {
+        // Each level simplifies the previous one, submesh by submesh so
+        // material ranges survive (their outlines count as locked borders)
+        MeshLod previous = this->mesh->lods.back();
+        float levelError = 0.0f;
+        size_t previousIndices = 0;
+
+        std::vector<SubMesh> levelSubmeshes;
+        std::vector<GLuint> levelIndices;
+
+        for (uint32_t i = 0; i < previous.submeshCount; i++)
+        {
+            const SubMesh submesh = this->mesh->submeshes[previous.submeshOffset + i];
+            size_t target = (size_t)(submesh.indexCount / 3 * LOD_REDUCTION) * 3;
+            std::vector<GLuint> simplified(submesh.indexCount);
+            float error = 0.0f;
+
+            size_t count = simplifyMesh(
+                simplified.data(),
+                this->indexData.data() + submesh.indexOffset,
+                submesh.indexCount,
+                this->vertexData.data(),
+                vertexTotal,
+                FLOATS_PER_VERTEX,
+                target,
+                &error);
+
+            previousIndices += submesh.indexCount;
+            levelError = std::max(levelError, error);
+
+            if (count == 0)
+                continue;
+
+            levelSubmeshes.push_back({
+                (uint32_t)(this->indexData.size() + levelIndices.size()),
+                (uint32_t)count,
+                submesh.materialId});
+            levelIndices.insert(levelIndices.end(), simplified.begin(), simplified.begin() + count);
+        }
+
+        // Stopping once locked seams and borders keep the mesh from shrinking
+        if (levelIndices.empty() || levelIndices.size() > previousIndices * 0.8f)
+            break;
+
+        // Errors add up since every level starts from the previous one
+        this->mesh->lods.push_back({
+            (uint32_t)this->mesh->submeshes.size(),
+            (uint32_t)levelSubmeshes.size(),
+            previous.error + levelError});
+
+        this->mesh->submeshes.insert(this->mesh->submeshes.end(), levelSubmeshes.begin(), levelSubmeshes.end());
+        this->indexData.insert(this->indexData.end(), levelIndices.begin(), levelIndices.end());
+    }
+}
+
+void ModelClass::optimizeMesh()
+{
+    size_t vertexTotal = this->vertexData.size() / FLOATS_PER_VERTEX;
+
+    // Level 0 comes first in the index buffer, the statistics cover only it
+    size_t fullIndices = 0;
+
+    for (uint32_t i = 0; i < this->mesh->lods[0].submeshCount; i++)
+        fullIndices += this->mesh->submeshes[i].indexCount;
+
+    VertexCacheStats before = analyzeVertexCache(this->indexData.data(), fullIndices, vertexTotal);
+
+    // Triangles only move within their submesh so material ranges stay valid
+    this->mesh->meshlets.clear();
+
+    for (const SubMesh &submesh : this->mesh->submeshes)
+    {
+        GLuint *indices = this->indexData.data() + submesh.indexOffset;
+
+        optimizeVertexCache(indices, submesh.indexCount, vertexTotal);
+
+        // Meshlets must stay contiguous, so they take over the overdraw ordering
+        if (this->meshletCulling)
+            buildMeshlets(
+                this->mesh->meshlets,
+                indices,
+                submesh.indexCount,
+                submesh.indexOffset,
+                this->vertexData.data(),
+                FLOATS_PER_VERTEX,
+                this->overdrawOrdering);
+        else if (this->overdrawOrdering)
+            optimizeOverdraw(indices, submesh.indexCount, this->vertexData.data(), FLOATS_PER_VERTEX);
+    }
+
+    optimizeVertexFetch(
+        this->vertexData.data(),
+        vertexTotal,
+        FLOATS_PER_VERTEX,
+        this->indexData.data(),
+        this->indexData.size());
+
+    VertexCacheStats after = analyzeVertexCache(this->indexData.data(), fullIndices, vertexTotal);
+
+    // One write so lines from parallel loads do not interleave
+    std::ostringstream report;
+    report << this->objPath << ": ACMR " << before.acmr << " -> " << after.acmr
+           << ", ATVR " << before.atvr << " -> " << after.atvr << ", LOD triangles";
+
+    for (const MeshLod &lod : this->mesh->lods)
+    {
+        size_t indices = 0;
+
+        for (uint32_t i = 0; i < lod.submeshCount; i++)
+            indices += this->mesh->submeshes[lod.submeshOffset + i].indexCount;
+
+        report << " " << indices / 3;
+    }
+
+    if (this->meshletCulling)
+        report << ", " << this->mesh->meshlets.size() << " meshlets";
+
+    report << "\n";
+    std::cout << report.str();
+}
+
+void ModelClass::packVertices()
+{
+    glm::vec3 extent = this->mesh->boundsMax - this->mesh->boundsMin;
+    glm::vec3 invExtent(
+        extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+        extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+        extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+    this->packedData.assign((size_t)this->mesh->vertexCount * PACKED_VERTEX_SIZE, 0);
+
+    for (GLsizei i = 0; i < this->mesh->vertexCount; i++)
+    {
+        const GLfloat *vertex = &this->vertexData[(size_t)i * FLOATS_PER_VERTEX];
+        unsigned char *out = &this->packedData[(size_t)i * PACKED_VERTEX_SIZE];
+
+        // POSITION, 0..1 across the bounds
+        glm::vec3 position = (glm::make_vec3(vertex) - this->mesh->boundsMin) * invExtent;
+        GLushort quantized[4] = {
+            (GLushort)glm::round(glm::clamp(position.x, 0.0f, 1.0f) * 65535.0f),
+            (GLushort)glm::round(glm::clamp(position.y, 0.0f, 1.0f) * 65535.0f),
+            (GLushort)glm::round(glm::clamp(position.z, 0.0f, 1.0f) * 65535.0f),
+            0};
+
+        // NORMAL and TANGENT (w keeps the bitangent sign)
+        glm::vec3 n = glm::make_vec3(vertex + 3);
+        n = glm::dot(n, n) > 0.0f ? glm::normalize(n) : n;
+
+        GLuint normal = glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+        GLuint tangent = glm::packSnorm3x10_1x2(glm::make_vec4(vertex + 8));
 
-        // ---------------------------------------------------
         // TEXTURE COORDINATES
-        this->vertexData.push_back(
-            attributes.texcoords[uvIndex]);
+        GLuint uv = glm::packHalf2x16(glm::make_vec2(vertex + 6));
 
-        this->vertexData.push_back(
-            attributes.texcoords[uvIndex + 1]);
+        std::memcpy(out, quantized, 8);
+        std::memcpy(out + 8, &normal, 4);
+        std::memcpy(out + 12, &uv, 4);
+        std::memcpy(out + 16, &tangent, 4);
+    }
 
-        // ---------------------------------------------------
-        // TANGENTS
+    this->layout = {
+        {0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0},         // Vertices
+        {1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 8},     // Normals
+        {2, 2, GL_HALF_FLOAT, GL_FALSE, 12},           // Texture coordinates
+        {3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 16},    // Tangents + handedness
+    };
+    this->mesh->vertexStride = PACKED_VERTEX_SIZE;
+    this->mesh->packedVertices = true;
+}
 
-        this->vertexData.push_back(
-            tangents[i].x);
-        this->vertexData.push_back(
-            tangents[i].y);
-        this->vertexData.push_back(
-            tangents[i].z);
+const void *ModelClass::getUploadVertices()
+{
+    if (this->meshCache.isOpen())
+        return this->meshCache.getVertices();
 
-        // ---------------------------------------------------
-        // BITANGENTS
+    if (this->packedVertices)
+        return this->packedData.data();
+
+    return this->vertexData.data();
+}
+
+std::string ModelClass::getCachePath()
+{
+    return this->objPath + (this->packedVertices ? ".packed.mesh" : ".mesh");
+}
+
+std::string ModelClass::getMeshKey()
+{
+    std::string key = AssetRegistry::canonicalPath(this->objPath);
+
+    if (this->packedVertices)
+        key += "|packed";
+
+    if (this->overdrawOrdering)
+        key += "|overdraw";
+
+    if (this->meshletCulling)
+        key += "|meshlets";
+
+    return key;
+}
+
+bool ModelClass::loadCache(uint64_t sourceHash)
+{
+    if (sourceHash == 0 || !this->meshCache.open(getCachePath(), sourceHash))
+        return false;
+
+    const MeshCacheHeader &header = this->meshCache.getHeader();
+
+    this->layout.assign(header.attributes, header.attributes + header.attributeCount);
+    this->mesh->vertexStride = (GLsizei)header.vertexStride;
+    this->mesh->packedVertices = this->packedVertices; // the cache path tells the layouts apart
+    this->mesh->vertexCount = (GLsizei)header.vertexCount;
+    this->mesh->indexCount = (GLsizei)header.indexCount;
+    this->mesh->boundsMin = glm::make_vec3(header.boundsMin);
+    this->mesh->boundsMax = glm::make_vec3(header.boundsMax);
+    this->mesh->boundsReady = true;
+
+    this->mesh->submeshes.assign(
+        this->meshCache.getSubMeshes(),
+        this->meshCache.getSubMeshes() + header.submeshCount);
+    this->mesh->lods.assign(
+        this->meshCache.getLods(),
+        this->meshCache.getLods() + header.lodCount);
+    this->mesh->meshlets.assign(
+        this->meshCache.getMeshlets(),
+        this->meshCache.getMeshlets() + header.meshletCount);
+
+    this->mesh->materialTexturePaths.clear();
+
+    for (uint32_t i = 0; i < header.materialCount; i++)
+        this->mesh->materialTexturePaths.push_back(this->meshCache.getMaterials()[i].diffuseTexture);
+
+    return true;
+}
+
+void ModelClass::writeCache(uint64_t sourceHash)
+{
+    if (sourceHash == 0)
+        return;
+
+    MeshCacheHeader header = {};
+    header.sourceHash = sourceHash;
+    header.vertexCount = (uint32_t)this->mesh->vertexCount;
+    header.vertexStride = (uint32_t)this->mesh->vertexStride;
+    header.indexCount = (uint32_t)this->mesh->indexCount;
+    header.attributeCount = (uint32_t)this->layout.size();
+    header.submeshCount = (uint32_t)this->mesh->submeshes.size();
+    header.lodCount = (uint32_t)this->mesh->lods.size();
+    header.meshletCount = (uint32_t)this->mesh->meshlets.size();
+    header.materialCount = (uint32_t)this->mesh->materialTexturePaths.size();
+
+    for (size_t i = 0; i < this->layout.size(); i++)
+        header.attributes[i] = this->layout[i];
+
+    for (int i = 0; i < 3; i++)
+    {
+        header.boundsMin[i] = this->mesh->boundsMin[i];
+        header.boundsMax[i] = this->mesh->boundsMax[i];
+    }
+
+    // Paths too long for the fixed-size entry are left out of the cache
+    std::vector<MeshMaterial> materials(this->mesh->materialTexturePaths.size(), MeshMaterial{});
+
+    for (size_t i = 0; i < materials.size(); i++)
+    {
+        if (this->mesh->materialTexturePaths[i].size() < MAX_MATERIAL_PATH)
+            std::strcpy(materials[i].diffuseTexture, this->mesh->materialTexturePaths[i].c_str());
+    }
+
+    if (!MeshCache::write(getCachePath(),
+                          header,
+                          getUploadVertices(),
+                          this->indexData.data(),
+                          this->mesh->submeshes.data(),
+                          this->mesh->lods.data(),
+                          this->mesh->meshlets.data(),
+                          materials.data()))
+        std::cout << "Could not write mesh cache for " << this->objPath << "\n";
+}
+void ModelClass::loadAll(const std::vector<ModelClass *> &models)
+{
+    for (ModelClass *model : models)
+        model->registerMesh();
+
+    parallelFor(models.size(), [&](size_t i)
+                { models[i]->loadObj(); });
+}
+
+void ModelClass::createAll(const std::vector<ModelClass *> &models)
+{
+    readTextureFiles(models);
+    decodeTextureFiles(models);
+
+    for (ModelClass *model : models)
+        model->finishLoading();
+}
+
+std::future<void> ModelClass::streamAll(const std::vector<ModelClass *> &models)
+{
+    // Attached textures are known before any mesh is loaded, their files
+    // are read in one batch up front. Meshes and images then share the
+    // workers in model order, without waiting for the other models.
+    for (ModelClass *model : models)
+        model->registerMesh();
+
+    return std::async(std::launch::async, [models]()
+                      {
+                          readTextureFiles(models);
+                          decodeTextureFiles(models, true); });
+}
+
+bool ModelClass::uploadReady(const std::vector<ModelClass *> &models, int maxUploads)
+{
+    bool allResident = true;
+
+    for (ModelClass *model : models)
+    {
+        if (model->resident)
+            continue;
+
+        if (maxUploads > 0 && model->cpuReady)
+        {
+            model->finishLoading();
+            maxUploads--;
+        }
+
+        allResident = allResident && model->resident;
+    }
+
+    return allResident;
+}
+
+void ModelClass::finishLoading()
+{
+    createVAO_VBO();
+    uploadTextures();
+    this->resident = true;
+}
+
+namespace
+{
+    // Registry key of an image, the same file in another internal format is another texture
+    std::string textureKey(const std::string &texPath, GLint format)
+    {
+        return AssetRegistry::canonicalPath(texPath) + "|" + std::to_string(format);
+    }
+
+    // Requests with the same key decode to the same texels
+    std::string decodeKey(const TextureRequest &request)
+    {
+        return textureKey(request.path, request.format) +
+               "|" + std::to_string(request.layerWidth) + "x" + std::to_string(request.layerHeight) +
+               "|" + std::to_string(request.normalMap) +
+               "|" + std::to_string(request.compress) +
+               "|" + std::to_string((uint32_t)request.blockFormat);
+    }
+
+    /// <summary>
+    /// Cache file of a request, named after the options its texels depend
+    /// on so variants of one image each keep their own file:
+    /// "enemy_sub_2.png.rgb.2048x2048.bc1.tex" for an array layer,
+    /// "submarine_Normal.png.rgb.normal.bc.tex" for a compressed normal map.
+    /// </summary>
+    std::string cachePathFor(const TextureRequest &request)
+    {
+        std::string path = request.path;
+
+        if (request.format == GL_RGB)
+            path += ".rgb";
+        else if (request.format == GL_RGBA)
+            path += ".rgba";
+        else
+            path += "." + std::to_string(request.format);
+
+        if (request.normalMap)
+            path += ".normal";
+
+        // Array layers have their size and block format set beforehand,
+        // other images pick their format once decoded
+        if (request.layerWidth > 0)
+        {
+            path += "." + std::to_string(request.layerWidth) + "x" + std::to_string(request.layerHeight);
+
+            if (request.blockFormat != BlockFormat::None)
+                path += std::string(".") + blockFormatName(request.blockFormat);
+        }
+        else if (request.compress)
+            path += ".bc";
+
+        return path + ".tex";
+    }
+
+    // Gives a request the texels another one with the same key decoded
+    void shareDecoded(const TextureRequest &decoded, TextureRequest &request)
+    {
+        request.pixels = decoded.pixels;
+        request.cache = decoded.cache;
+        request.width = decoded.width;
+        request.height = decoded.height;
+        request.channels = decoded.channels;
+        request.levels = decoded.levels;
+        request.blockFormat = decoded.blockFormat;
+    }
+
+    // Images are flipped vertically on load, part of the texture cache key
+    const int FLIP_ON_LOAD = 1;
+
+    // Colour is filtered in linear light with the sharper Kaiser filter,
+    // normal maps with a plain box (their texels are not sRGB)
+    MipOptions mipOptionsFor(const TextureRequest &request)
+    {
+        MipOptions options;
+
+        if (!request.normalMap)
+        {
+            options.filter = MipFilter::Kaiser;
+            options.srgb = true;
+            // Loaded alpha may be alpha-tested, its coverage should not thin out with distance
+            options.preserveCoverage = request.format == GL_RGBA;
+        }
+
+        return options;
+    }
+
+    /// <summary>
+    /// Block format of a decoded image: the array's for array layers, BC5
+    /// for normal maps, BC3 for images whose alpha is loaded and used (less
+    /// than fully opaque somewhere), BC1 for the rest.
+    /// </summary>
+    BlockFormat blockFormatFor(const TextureRequest &request)
+    {
+        if (request.layerWidth > 0)
+            return request.blockFormat;
+
+        if (!request.compress)
+            return BlockFormat::None;
+
+        if (request.normalMap)
+            return BlockFormat::BC5;
+
+        bool opaque = request.format == GL_RGB ||
+                      isOpaque(request.pixels.get(), request.width, request.height, request.channels);
+
+        return opaque ? BlockFormat::BC1 : BlockFormat::BC3;
+    }
+
+    // Replaces the image and the levels below it by their blocks
+    void compressChain(TextureRequest &request, std::vector<MipLevel> &levels, BlockFormat format)
+    {
+        std::shared_ptr<unsigned char> blocks(
+            new unsigned char[imageBytes(format, request.width, request.height, request.channels)],
+            std::default_delete<unsigned char[]>());
+
+        compressImage(request.pixels.get(), request.width, request.height, request.channels, format, blocks.get());
+        request.pixels = blocks;
+
+        for (MipLevel &level : levels)
+        {
+            std::vector<unsigned char> levelBlocks(imageBytes(format, level.width, level.height, request.channels));
+            compressImage(level.pixels.data(), level.width, level.height, request.channels, format, levelBlocks.data());
+            level.pixels = std::move(levelBlocks);
+        }
+    }
+
+    /// <summary>
+    /// Maps the image's predecoded mip chain (texPath + ".tex") when it is
+    /// current. Otherwise decodes the image, resamples it to the size of
+    /// its array layer, builds its mip chain, compresses it and writes the
+    /// cache; pixels are only kept when that write fails.
+    /// </summary>
+    void decodeImage(TextureRequest &request)
+    {
+        AssetFile file;
+
+        // Read on its own when the batch did not get to it
+        if (request.encoded.empty() && file.open(request.path))
+            request.encoded.assign(file.data(), file.data() + file.size());
+
+        if (request.encoded.empty())
+            return;
+
+        // Keyed on the file and everything that changes the decoded texels
+        uint64_t sourceHash = hashBytes(request.encoded.data(), request.encoded.size());
+        sourceHash = hashBytes(&request.format, sizeof(request.format), sourceHash);
+        sourceHash = hashBytes(&FLIP_ON_LOAD, sizeof(FLIP_ON_LOAD), sourceHash);
+        sourceHash = hashBytes(&request.layerWidth, sizeof(request.layerWidth), sourceHash);
+        sourceHash = hashBytes(&request.layerHeight, sizeof(request.layerHeight), sourceHash);
+        sourceHash = hashBytes(&request.compress, sizeof(request.compress), sourceHash);
+        sourceHash = hashBytes(&request.blockFormat, sizeof(request.blockFormat), sourceHash);
+
+        MipOptions mipOptions = mipOptionsFor(request);
+        sourceHash = hashBytes(&mipOptions.filter, sizeof(mipOptions.filter), sourceHash);
+        sourceHash = hashBytes(&mipOptions.srgb, sizeof(mipOptions.srgb), sourceHash);
+        sourceHash = hashBytes(&mipOptions.preserveCoverage, sizeof(mipOptions.preserveCoverage), sourceHash);
+        sourceHash = hashBytes(&mipOptions.alphaCutoff, sizeof(mipOptions.alphaCutoff), sourceHash);
+
+        std::string cachePath = cachePathFor(request);
+        request.cache = std::make_shared<TextureCache>();
+
+        PhaseTimer cacheTimer(request.path, "cache load");
+        bool cached = request.cache->open(cachePath, sourceHash);
+        cacheTimer.stop();
+
+        if (!cached)
+        {
+            // Flip image vertically on load (thread-local, the decode runs on the workers)
+            stbi_set_flip_vertically_on_load_thread(FLIP_ON_LOAD);
+            PhaseTimer decodeTimer(request.path, "decode");
+
+            unsigned char *bytes = stbi_load_from_memory(
+                request.encoded.data(), (int)request.encoded.size(),
+                &request.width, &request.height, &request.channels,
+                0);
+
+            request.pixels = std::shared_ptr<unsigned char>(bytes, stbi_image_free);
+            decodeTimer.stop();
+
+            // Array layers are cached at the array's size
+            int width = request.layerWidth;
+            int height = request.layerHeight;
+
+            if (request.pixels && width > 0 && (request.width != width || request.height != height))
+            {
+                PhaseTimer resampleTimer(request.path, "resample");
+                std::shared_ptr<unsigned char> resampled(
+                    new unsigned char[(size_t)width * height * request.channels],
+                    std::default_delete<unsigned char[]>());
+
+                resampleImage(request.pixels.get(), request.width, request.height, request.channels, resampled.get(), width, height);
+
+                request.pixels = resampled;
+                request.width = width;
+                request.height = height;
+            }
+
+            if (request.pixels)
+            {
+                PhaseTimer mipTimer(request.path, "mipmaps");
+                std::vector<MipLevel> levels;
+                buildMipChain(request.pixels.get(), request.width, request.height, request.channels, levels, mipOptions);
+                mipTimer.stop();
+
+                BlockFormat blockFormat = blockFormatFor(request);
+
+                if (blockFormat != BlockFormat::None)
+                {
+                    PhaseTimer compressTimer(request.path, "compress");
+                    compressChain(request, levels, blockFormat);
+                }
+
+                TextureCacheHeader header = {};
+                header.sourceHash = sourceHash;
+                header.width = (uint32_t)request.width;
+                header.height = (uint32_t)request.height;
+                header.channels = (uint32_t)request.channels;
+                header.internalFormat = blockFormat != BlockFormat::None ? (GLint)compressedFormat(blockFormat) : request.format;
+                header.pixelFormat = (request.channels == 3) ? GL_RGB : GL_RGBA;
+                header.pixelType = GL_UNSIGNED_BYTE;
+                header.blockFormat = (uint32_t)blockFormat;
+
+                PhaseTimer writeTimer(request.path, "cache write");
+                cached = TextureCache::write(cachePath, header, request.pixels.get(), levels) &&
+                         request.cache->open(cachePath, sourceHash);
+
+                // Uploaded from memory instead
+                if (!cached)
+                {
+                    request.levels = std::move(levels);
+                    request.blockFormat = blockFormat;
+                }
+            }
+        }
+
+        // Uploading from the mapped cache when there is one, from the pixels otherwise
+        if (cached)
+            request.pixels.reset();
+        else
+            request.cache.reset();
+
+        std::vector<unsigned char>().swap(request.encoded);
+    }
+
+    // Estimated GPU memory of every level of a cached texture
+    size_t textureBytes(const MipSource &source)
+    {
+        size_t bytes = 0;
+
+        for (int level = 0; level < source.levelCount(); level++)
+            bytes += source.levelBytes(level);
+
+        return bytes;
+    }
+
+    // Estimated GPU memory of the base level of an image uploaded from memory
+    size_t textureBytes(const TextureRequest &request)
+    {
+        if (request.blockFormat != BlockFormat::None)
+            return imageBytes(request.blockFormat, request.width, request.height, request.channels);
+
+        return (size_t)request.width * request.height * texelBytes(request.format);
+    }
+
+    /// <summary>
+    /// Uploads a decoded image with a full mipmap chain, or only its coarse
+    /// levels when streamMips is set or the whole chain would go over the
+    /// texture budget.
+    /// </summary>
+    GLuint uploadImage(TextureRequest &request, bool streamMips)
+    {
+        PhaseTimer timer(request.path, "upload");
+
+        // Initialize texture variable
+        GLuint tex;
+        glGenTextures(1, &tex);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, tex);
+
+        // Every level precomputed, nothing left for the driver to filter
+        if (request.cache && (streamMips || !TextureStreamer::fits(textureBytes(*request.cache))))
+        {
+            request.residentLevel = TextureStreamer::uploadCoarse(*request.cache);
+            return tex;
+        }
+
+        if (request.cache)
+        {
+            request.cache->upload();
+            return tex;
+        }
+
+        // Images that could not be read leave the texture empty
+        if (!request.pixels)
+            return tex;
+
+        // Attach loaded image and its mip chain (built on the worker) level by level.
+        // Without a cache the streamer never releases its levels, so the storage can be immutable.
+        GLenum pixelFormat = (request.channels == 3) ? GL_RGB : GL_RGBA;
+        GLenum blocks = compressedFormat(request.blockFormat);
+        GLint internalFormat = blocks != GL_NONE ? (GLint)blocks : request.format;
+        size_t bytes = imageBytes(request.blockFormat, request.width, request.height, request.channels);
+
+        TextureUploader::allocate(GL_TEXTURE_2D, (GLsizei)request.levels.size() + 1, internalFormat,
+                                  request.width, request.height, pixelFormat, GL_UNSIGNED_BYTE);
+
+        if (blocks != GL_NONE)
+            TextureUploader::compressedSubImage2D(GL_TEXTURE_2D, 0, request.width, request.height, blocks,
+                                                  request.pixels.get(), bytes);
+        else
+            TextureUploader::subImage2D(GL_TEXTURE_2D, 0, request.width, request.height, pixelFormat, GL_UNSIGNED_BYTE,
+                                        request.pixels.get(), bytes);
 
-        this->vertexData.push_back(
-            bitangents[i].x);
-        this->vertexData.push_back(
-            bitangents[i].y);
-        this->vertexData.push_back(
-            bitangents[i].z);
+        for (size_t i = 0; i < request.levels.size(); i++)
+        {
+            const MipLevel &level = request.levels[i];
+
+            if (blocks != GL_NONE)
+                TextureUploader::compressedSubImage2D(GL_TEXTURE_2D, (GLint)i + 1, level.width, level.height, blocks,
+                                                      level.pixels.data(), level.pixels.size());
+            else
+                TextureUploader::subImage2D(GL_TEXTURE_2D, (GLint)i + 1, level.width, level.height, pixelFormat, GL_UNSIGNED_BYTE,
+                                            level.pixels.data(), level.pixels.size());
+        }
+
+        return tex;
+    }
+
+    // Attached, not decoded yet, and not already made by another model
+    // (array layers are always decoded, they are not shared through the registry)
+    bool needsDecode(const TextureRequest &request)
+    {
+        return !request.path.empty() && !request.pixels && !request.cache &&
+               (request.layerWidth > 0 || !AssetRegistry::findTexture(textureKey(request.path, request.format)));
+    }
+
+    TextureHandle acquireTexture(TextureRequest &request, bool streamMips)
+    {
+        if (request.path.empty())
+            return nullptr;
+
+        bool created = false;
+        TextureHandle texture = AssetRegistry::acquireTexture(textureKey(request.path, request.format), [&]()
+                                                              {
+                                                                  // Skipped at decode time, but the other user has let go since
+                                                                  if (!request.pixels && !request.cache)
+                                                                      decodeImage(request);
+
+                                                                  return uploadImage(request, streamMips); },
+                                                              &created);
+
+        // The streamer keeps the cache mapped for the finer levels (or to
+        // reload the ones it drops over budget)
+        if (created && request.cache)
+            TextureStreamer::add(texture, request.cache, request.residentLevel, request.path);
+        else if (created && request.pixels)
+            TextureStreamer::track(texture, textureBytes(request) * 4 / 3, request.path);
+
+        return texture;
     }
 }
+
 void ModelClass::attachTexture(std::string texPath, GLint format)
 {
-    // Flip image vertically on load
-    stbi_set_flip_vertically_on_load(true);
+    TextureRequest request;
+    request.path = texPath;
+    request.format = format;
+    request.compress = this->textureCompression;
+    this->textureRequests.push_back(std::move(request));
+
+    if (this->textureArray && this->textureRequests.size() == 1)
+    {
+        this->textureRequests[0].layerWidth = this->textureArray->getWidth();
+        this->textureRequests[0].layerHeight = this->textureArray->getHeight();
+        this->textureRequests[0].blockFormat = this->textureArray->blockFormat();
+    }
+}
+
+void ModelClass::useTextureArray(const std::shared_ptr<TextureArray> &array, int layer)
+{
+    this->textureArray = array;
+    this->textureLayer = layer;
 
-    // Initialize variables for loading the texture
-    int img_width, img_height, colorChannels;
+    if (!this->textureRequests.empty())
+    {
+        this->textureRequests[0].layerWidth = array->getWidth();
+        this->textureRequests[0].layerHeight = array->getHeight();
+        this->textureRequests[0].blockFormat = array->blockFormat();
+    }
+}
 
-    unsigned char *tex_bytes = stbi_load(
-        texPath.c_str(),
-        &img_width, &img_height, &colorChannels,
-        0);
+std::vector<std::shared_ptr<TextureArray>> ModelClass::shareTextureArrays(const std::vector<ModelClass *> &models,
+                                                                          bool streamed, bool compress)
+{
+    struct Probe
+    {
+        bool ok = false;
+        int width = 0, height = 0;
+        bool opaque = true;
+    };
 
-    // Initialize texture variable
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, tex);
+    std::vector<Probe> probes(models.size());
+
+    parallelFor(models.size(), [&](size_t i)
+                {
+                    if (models[i]->textureRequests.empty() || models[i]->textureRequests[0].path.empty())
+                        return;
+
+                    // Only the header is parsed, the image is decoded later with the others
+                    const TextureRequest &request = models[i]->textureRequests[0];
+                    AssetFile file;
+                    int channels = 0;
 
-    // Attach loaded image to texture variable
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        format,
-        img_width,
-        img_height,
-        0,
-        (colorChannels == 3) ? GL_RGB : GL_RGBA,
-        GL_UNSIGNED_BYTE,
-        tex_bytes);
-    // Generate Mipmap
-    glGenerateMipmap(GL_TEXTURE_2D);
+                    if (!file.open(request.path) ||
+                        !stbi_info_from_memory(file.data(), (int)file.size(), &probes[i].width, &probes[i].height, &channels))
+                        return;
 
-    // Free up loaded bytes
-    stbi_image_free(tex_bytes);
+                    probes[i].ok = true;
 
-    this->textures.push_back(tex);
+                    // Only an alpha that is loaded and used anywhere needs BC3, finding out takes a decode
+                    if (compress && request.format != GL_RGB && (channels == 2 || channels == 4))
+                    {
+                        int width = 0, height = 0;
+                        unsigned char *pixels = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &channels, 0);
+                        probes[i].opaque = pixels == nullptr || isOpaque(pixels, width, height, channels);
+                        stbi_image_free(pixels);
+                    } });
+
+    // Ordered so the arrays come out the same way every run
+    std::map<std::pair<int, int>, std::vector<size_t>> bySize;
+
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        if (probes[i].ok)
+            bySize[{probes[i].width, probes[i].height}].push_back(i);
+    }
+
+    std::vector<std::shared_ptr<TextureArray>> arrays;
+
+    for (const auto &group : bySize)
+    {
+        const std::vector<size_t> &members = group.second;
+
+        if (members.size() < 2)
+            continue;
+
+        BlockFormat format = BlockFormat::None;
+
+        if (compress)
+        {
+            bool opaque = std::all_of(members.begin(), members.end(), [&](size_t i)
+                                      { return probes[i].opaque; });
+            format = opaque ? BlockFormat::BC1 : BlockFormat::BC3;
+        }
+
+        std::shared_ptr<TextureArray> array = TextureArray::create((int)members.size(), streamed,
+                                                                   group.first.first, group.first.second, format);
+
+        for (size_t i = 0; i < members.size(); i++)
+            models[members[i]]->useTextureArray(array, (int)i);
+
+        arrays.push_back(array);
+    }
+
+    return arrays;
 }
 
 void ModelClass::attachNormalTexture(std::string texPath, GLint format)
 {
     this->withNormals = true;
     attachTexture(texPath, format);
+    this->textureRequests.back().normalMap = true;
+}
+
+void ModelClass::attachMaterialTextures(GLint format)
+{
+    this->materialTextureFormat = format;
+}
+
+void ModelClass::queueMaterialTextures()
+{
+    // Only the model that loaded the mesh fills its material textures
+    if (this->ownsMeshData && this->materialTextureFormat != 0 && this->materialRequests.empty())
+    {
+        for (const std::string &texPath : this->mesh->materialTexturePaths)
+        {
+            TextureRequest request;
+            request.path = texPath;
+            request.format = this->materialTextureFormat;
+            request.compress = this->textureCompression;
+            this->materialRequests.push_back(std::move(request));
+        }
+    }
+}
+
+void ModelClass::loadWithMaterials()
+{
+    loadObj();
+    queueMaterialTextures();
+
+    std::vector<TextureRequest *> targets;
+
+    for (TextureRequest &request : this->materialRequests)
+    {
+        if (needsDecode(request) && request.encoded.empty())
+            targets.push_back(&request);
+    }
+
+    std::vector<FileRead> reads(targets.size());
+
+    for (size_t i = 0; i < targets.size(); i++)
+        reads[i].path = targets[i]->path;
+
+    readBatch(reads);
+
+    for (size_t i = 0; i < targets.size(); i++)
+        targets[i]->encoded = std::move(reads[i].bytes);
+
+    for (TextureRequest &request : this->materialRequests)
+    {
+        if (needsDecode(request))
+            decodeImage(request);
+    }
+}
+
+void ModelClass::readTextureFiles(const std::vector<ModelClass *> &models)
+{
+    std::vector<TextureRequest *> targets;
+    std::unordered_set<std::string> queued;
+
+    for (ModelClass *model : models)
+    {
+        model->queueMaterialTextures();
+
+        for (std::vector<TextureRequest> *requests : {&model->textureRequests, &model->materialRequests})
+        {
+            for (TextureRequest &request : *requests)
+            {
+                // decodeTextureFiles decodes the first request of each key, the others share it
+                if (needsDecode(request) && queued.insert(decodeKey(request)).second && request.encoded.empty())
+                    targets.push_back(&request);
+            }
+        }
+    }
+
+    std::vector<FileRead> reads(targets.size());
+
+    for (size_t i = 0; i < targets.size(); i++)
+        reads[i].path = targets[i]->path;
+
+    readBatch(reads);
+
+    for (size_t i = 0; i < targets.size(); i++)
+        targets[i]->encoded = std::move(reads[i].bytes);
+}
+
+void ModelClass::decodeTextureFiles(const std::vector<ModelClass *> &models, bool loadMeshes)
+{
+    // One job per image rather than per model, so a model with several
+    // large textures does not keep the other workers idle. Models asking
+    // for the same image join the job of the first one instead.
+    struct DecodeJob
+    {
+        // The first request is decoded, the others get its texels
+        std::vector<TextureRequest *> requests;
+        std::vector<size_t> models;
+        // Loads the mesh of models[0] instead
+        bool loadMesh = false;
+    };
+
+    std::vector<DecodeJob> jobs;
+    std::unordered_map<std::string, size_t> jobOfKey;
+    std::vector<std::atomic<int>> remaining(models.size());
+
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        models[i]->queueMaterialTextures();
+        int pending = 0;
+
+        if (loadMeshes)
+        {
+            jobs.emplace_back();
+            jobs.back().models.push_back(i);
+            jobs.back().loadMesh = true;
+            pending++;
+        }
+
+        for (std::vector<TextureRequest> *requests : {&models[i]->textureRequests, &models[i]->materialRequests})
+        {
+            for (TextureRequest &request : *requests)
+            {
+                if (!needsDecode(request))
+                    continue;
+
+                auto found = jobOfKey.emplace(decodeKey(request), jobs.size());
+
+                if (found.second)
+                    jobs.emplace_back();
+
+                jobs[found.first->second].requests.push_back(&request);
+                jobs[found.first->second].models.push_back(i);
+                pending++;
+            }
+        }
+
+        remaining[i] = pending;
+
+        if (pending == 0)
+            models[i]->cpuReady = true;
+    }
+
+    // Jobs are taken in order, so the first models are ready first
+    parallelFor(jobs.size(), [&](size_t i)
+                {
+                    DecodeJob &job = jobs[i];
+
+                    if (job.loadMesh)
+                        models[job.models[0]]->loadWithMaterials();
+                    else
+                    {
+                        decodeImage(*job.requests[0]);
+
+                        for (size_t k = 1; k < job.requests.size(); k++)
+                            shareDecoded(*job.requests[0], *job.requests[k]);
+                    }
+
+                    for (size_t model : job.models)
+                    {
+                        if (--remaining[model] == 0)
+                            models[model]->cpuReady = true;
+                    } });
+}
+
+void ModelClass::uploadTextures()
+{
+    for (TextureRequest &request : this->textureRequests)
+    {
+        // The base texture goes to its layer, the normal map stays a texture of its own
+        if (this->textureArray && &request == &this->textureRequests[0])
+        {
+            if (!request.pixels && !request.cache && !request.path.empty())
+                decodeImage(request);
+
+            BlockFormat format = request.cache ? request.cache->blockFormat() : request.blockFormat;
+
+            if (!request.pixels && !request.cache)
+                continue;
+
+            if (this->textureArray->accepts(format))
+            {
+                this->textureArray->setLayer(this->textureLayer,
+                                             {request.cache, request.pixels, std::move(request.levels), request.channels, request.blockFormat});
+                continue;
+            }
+
+            // Rather than an empty layer, the texture is drawn on its own like any other
+            std::cout << request.path << " is " << blockFormatName(format) << ", its texture array holds "
+                      << blockFormatName(this->textureArray->blockFormat()) << ": using a texture of its own\n";
+
+            this->textureArray.reset();
+            this->textureLayer = -1;
+        }
+
+        this->textures.push_back(acquireTexture(request, this->mipStreaming));
+    }
+
+    if (!this->materialRequests.empty())
+    {
+        this->mesh->materialTextures.clear();
+
+        for (TextureRequest &request : this->materialRequests)
+            this->mesh->materialTextures.push_back(acquireTexture(request, this->mipStreaming));
+    }
+
+    // The decoded pixels are freed with the requests
+    this->textureRequests.clear();
+    this->materialRequests.clear();
+}
+
+float ModelClass::pixelsPerUnit(const glm::mat4 &transform, const glm::mat4 &projection, const glm::mat4 &view, float viewportHeight)
+{
+    glm::vec3 center = (this->mesh->boundsMin + this->mesh->boundsMax) * 0.5f;
+    glm::vec4 clip = projection * view * transform * glm::vec4(center, 1.0f);
+    float scale = glm::max(
+        glm::length(glm::vec3(transform[0])),
+        glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+    // Inside the near plane everything is as large as it gets
+    if (clip.w <= 0.0f)
+        return FLT_MAX;
+
+    return scale * projection[1][1] * 0.5f * viewportHeight / clip.w;
+}
+
+int ModelClass::selectLod(float perUnit)
+{
+    if (this->mesh->lods.size() < 2)
+        return 0;
+
+    if (perUnit == FLT_MAX)
+    {
+        this->currentLod = 0;
+        return 0;
+    }
+
+    auto screenError = [&](int lod)
+    {
+        return this->mesh->lods[lod].error * perUnit;
+    };
+
+    // Refining right away, coarsening only with some margin so a mesh sitting
+    // on a threshold does not flicker between two levels
+    int lod = glm::min(this->currentLod, (int)this->mesh->lods.size() - 1);
+
+    while (lod > 0 && screenError(lod) > LOD_PIXEL_ERROR)
+        lod--;
+
+    while (lod + 1 < (int)this->mesh->lods.size() && screenError(lod + 1) < LOD_PIXEL_ERROR * LOD_HYSTERESIS)
+        lod++;
+
+    this->currentLod = lod;
+    return lod;
+}
+
+void ModelClass::requestTextureDetail(float pixelsPerUnit)
+{
+    // The bounds' diagonal stands in for the texture's extent on screen
+    float screenPixels = pixelsPerUnit == FLT_MAX
+                             ? FLT_MAX
+                             : glm::length(this->mesh->boundsMax - this->mesh->boundsMin) * pixelsPerUnit;
+
+    for (const TextureHandle &texture : this->textures)
+        TextureStreamer::request(texture, screenPixels);
+
+    if (this->textureArray)
+        TextureStreamer::request(this->textureArray->getTexture(), screenPixels);
+
+    for (const TextureHandle &texture : this->mesh->materialTextures)
+        TextureStreamer::request(texture, screenPixels);
+}
+
+namespace
+{
+    // Unit cube drawn over the bounds of models still streaming, with a 1x1
+    // base texture and a 1x1 flat normal map. Made on first use and kept for the whole run.
+    GLuint placeholderVAO = 0;
+    GLuint placeholderTextures[2] = {0, 0};
+    const GLsizei PLACEHOLDER_INDEX_COUNT = 36;
+
+    // Locations of the per-model uniforms, looked up again only when another program draws
+    struct ModelUniforms
+    {
+        GLuint program = 0;
+        GLint posOffset = -1;
+        GLint posScale = -1;
+        GLint texLayer = -1;
+    };
+
+    ModelUniforms modelUniforms;
+
+    const ModelUniforms &uniformsOf(GLuint shaderProgram)
+    {
+        if (modelUniforms.program != shaderProgram)
+        {
+            modelUniforms.program = shaderProgram;
+            modelUniforms.posOffset = glGetUniformLocation(shaderProgram, "posOffset");
+            modelUniforms.posScale = glGetUniformLocation(shaderProgram, "posScale");
+            modelUniforms.texLayer = glGetUniformLocation(shaderProgram, "texLayer");
+        }
+
+        return modelUniforms;
+    }
+
+    void createPlaceholder()
+    {
+        // Position (0..1), normal, uv and tangent + handedness per face corner
+        std::vector<GLfloat> vertices;
+        std::vector<GLuint> indices;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int side = 0; side < 2; side++)
+            {
+                glm::vec3 normal(0.0f);
+                normal[axis] = side == 0 ? -1.0f : 1.0f;
+
+                // Two in-plane axes ordered so the corners wind counter-clockwise from outside
+                int u = (axis + (side == 0 ? 2 : 1)) % 3;
+                int v = (axis + (side == 0 ? 1 : 2)) % 3;
+                GLuint base = (GLuint)(vertices.size() / FLOATS_PER_VERTEX);
+
+                for (int corner = 0; corner < 4; corner++)
+                {
+                    glm::vec3 position(0.0f);
+                    position[axis] = (float)side;
+                    position[u] = (float)(corner == 1 || corner == 2);
+                    position[v] = (float)(corner >= 2);
+
+                    glm::vec3 tangent(0.0f);
+                    tangent[u] = 1.0f;
+
+                    GLfloat vertex[FLOATS_PER_VERTEX] = {
+                        position.x, position.y, position.z,
+                        normal.x, normal.y, normal.z,
+                        position[u], position[v],
+                        tangent.x, tangent.y, tangent.z, 1.0f};
+
+                    vertices.insert(vertices.end(), vertex, vertex + FLOATS_PER_VERTEX);
+                }
+
+                GLuint quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+
+        GLuint buffers[2];
+        glGenVertexArrays(1, &placeholderVAO);
+        glGenBuffers(2, buffers);
+
+        glBindVertexArray(placeholderVAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+        const GLint components[4] = {3, 3, 2, 4};
+        const GLint offsets[4] = {0, 3, 6, 8};
+
+        for (GLuint location = 0; location < 4; location++)
+        {
+            glVertexAttribPointer(
+                location,
+                components[location],
+                GL_FLOAT,
+                GL_FALSE,
+                FLOATS_PER_VERTEX * sizeof(GLfloat),
+                (void *)(offsets[location] * sizeof(GLfloat)));
+
+            glEnableVertexAttribArray(location);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
+        // Mid grey, and a normal map texel pointing straight out for models that sample one
+        const unsigned char texels[2][4] = {{128, 128, 128, 255}, {128, 128, 255, 255}};
+
+        glGenTextures(2, placeholderTextures);
+
+        for (int i = 0; i < 2; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, placeholderTextures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+    }
+}
+
+bool ModelClass::drawPlaceholder(GLuint shaderProgram)
+{
+    if (isResident())
+        return false;
+
+    if (!this->mesh->boundsReady)
+        return true;
+
+    if (placeholderVAO == 0)
+        createPlaceholder();
+
+    // Stretching the unit cube over the bounds through the packed-position uniforms
+    glm::vec3 posOffset = this->mesh->boundsMin;
+    glm::vec3 posScale = this->mesh->boundsMax - this->mesh->boundsMin;
+
+    const ModelUniforms &uniforms = uniformsOf(shaderProgram);
+    glUniform3fv(uniforms.posOffset, 1, glm::value_ptr(posOffset));
+    glUniform3fv(uniforms.posScale, 1, glm::value_ptr(posScale));
+    glUniform1i(uniforms.texLayer, -1);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, placeholderTextures[1]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, placeholderTextures[0]);
+
+    glBindVertexArray(placeholderVAO);
+    glDrawElements(GL_TRIANGLES, PLACEHOLDER_INDEX_COUNT, GL_UNSIGNED_INT, (void *)0);
+
+    return true;
+}
+
+void ModelClass::drawSubmeshes(GLuint shaderProgram, int lod, const MeshletCuller *culler)
+{
+    // Packed positions are 0..1 across the bounds, float ones pass through
+    bool packed = this->mesh->packedVertices;
+    glm::vec3 posOffset = packed ? this->mesh->boundsMin : glm::vec3(0.0f);
+    glm::vec3 posScale = packed ? this->mesh->boundsMax - this->mesh->boundsMin : glm::vec3(1.0f);
+
+    const ModelUniforms &uniforms = uniformsOf(shaderProgram);
+    glUniform3fv(uniforms.posOffset, 1, glm::value_ptr(posOffset));
+    glUniform3fv(uniforms.posScale, 1, glm::value_ptr(posScale));
+
+    // Array models have no base texture of their own, 0 stands for their layer
+    GLuint baseTexture = this->textures.empty() || this->textureArray ? 0 : this->textures[0]->id;
+    GLuint boundTexture = baseTexture;
+    GLint layerLocation = uniforms.texLayer;
+
+    auto textureOf = [&](const SubMesh &submesh)
+    {
+        if (submesh.materialId >= 0 &&
+            submesh.materialId < (int)this->mesh->materialTextures.size() &&
+            this->mesh->materialTextures[submesh.materialId])
+            return this->mesh->materialTextures[submesh.materialId]->id;
+
+        return baseTexture;
+    };
+
+    // Meshes without levels draw all their submeshes
+    size_t first = 0;
+    size_t last = this->mesh->submeshes.size();
+
+    if (lod >= 0 && lod < (int)this->mesh->lods.size())
+    {
+        first = this->mesh->lods[lod].submeshOffset;
+        last = first + this->mesh->lods[lod].submeshCount;
+    }
+
+    for (size_t i = first; i < last;)
+    {
+        const SubMesh &submesh = this->mesh->submeshes[i];
+        GLuint texture = textureOf(submesh);
+
+        // Neighbouring submeshes with the same texture go out as one draw
+        GLsizei count = submesh.indexCount;
+        size_t next = i + 1;
+
+        while (next < last &&
+               this->mesh->submeshes[next].indexOffset == submesh.indexOffset + count &&
+               textureOf(this->mesh->submeshes[next]) == texture)
+        {
+            count += this->mesh->submeshes[next].indexCount;
+            next++;
+        }
+
+        if (texture != boundTexture)
+        {
+            // Submeshes with a material texture of their own sample tex0 instead of the layer
+            if (this->textureArray)
+                glUniform1i(layerLocation, texture == baseTexture ? this->textureLayer : -1);
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            boundTexture = texture;
+        }
+
+        if (culler == nullptr || this->mesh->meshlets.empty())
+        {
+            glDrawElements(
+                GL_TRIANGLES,
+                count,
+                GL_UNSIGNED_INT,
+                (void *)(sizeof(GLuint) * submesh.indexOffset));
+
+            i = next;
+            continue;
+        }
+
+        // Surviving meshlets, with neighbours in the index buffer joined into one range
+        uint32_t end = submesh.indexOffset + count;
+        auto meshlet = std::lower_bound(
+            this->mesh->meshlets.begin(),
+            this->mesh->meshlets.end(),
+            submesh.indexOffset,
+            [](const Meshlet &m, uint32_t offset)
+            { return m.indexOffset < offset; });
+
+        this->drawCounts.clear();
+        this->drawOffsets.clear();
+        uint32_t rangeEnd = 0;
+
+        for (; meshlet != this->mesh->meshlets.end() && meshlet->indexOffset < end; ++meshlet)
+        {
+            if (!culler->isVisible(*meshlet))
+                continue;
+
+            if (!this->drawCounts.empty() && meshlet->indexOffset == rangeEnd)
+            {
+                this->drawCounts.back() += meshlet->indexCount;
+            }
+            else
+            {
+                this->drawCounts.push_back(meshlet->indexCount);
+                this->drawOffsets.push_back((void *)(sizeof(GLuint) * meshlet->indexOffset));
+            }
+
+            rangeEnd = meshlet->indexOffset + meshlet->indexCount;
+        }
+
+        if (!this->drawCounts.empty())
+            glMultiDrawElements(
+                GL_TRIANGLES,
+                this->drawCounts.data(),
+                GL_UNSIGNED_INT,
+                this->drawOffsets.data(),
+                (GLsizei)this->drawCounts.size());
+
+        i = next;
+    }
+
+    // Leaving the base texture (or layer) selected for whoever draws next
+    if (boundTexture != baseTexture)
+    {
+        if (this->textureArray)
+            glUniform1i(layerLocation, this->textureLayer);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, baseTexture);
+    }
+}
+
+void ModelClass::bindTextures(GLuint shaderProgram)
+{
+    // The array itself stays bound on its own unit across the whole group
+    glUniform1i(uniformsOf(shaderProgram).texLayer, this->textureArray ? this->textureLayer : -1);
+
+    // The normal map follows the base texture, wherever that is
+    size_t normals = this->textureArray ? 0 : 1;
+
+    if (!this->textureArray)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, this->textures[0]->id);
+    }
+
+    if (withNormals)
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, this->textures[normals]->id);
+    }
 }
 
 void ModelClass::createVAO_VBO()
 {
-    GLintptr normalPtr = 3 * sizeof(GL_FLOAT);
-    GLintptr uvPtr = 6 * sizeof(GL_FLOAT);
-    GLintptr tangentPtr = 8 * sizeof(GL_FLOAT);
-    GLintptr bitangentPtr = 11 * sizeof(GL_FLOAT);
+    // Models sharing the mesh get the buffers from the one that loaded it
+    if (!this->ownsMeshData || this->mesh->VAO != 0)
+        return;
 
-    glGenVertexArrays(1, &this->VAO);
-    glGenBuffers(1, &this->VBO);
+    // Uploading straight from the mapped cache when the mesh came from one
+    const void *vertices = getUploadVertices();
+    const GLuint *indices = this->meshCache.isOpen() ? this->meshCache.getIndices() : this->indexData.data();
+    GLsizeiptr vertexBytes = (GLsizeiptr)this->mesh->vertexCount * this->mesh->vertexStride;
+    PhaseTimer timer(this->objPath, "vao");
 
-    glBindVertexArray(this->VAO);
+    glGenVertexArrays(1, &this->mesh->VAO);
+    glGenBuffers(1, &this->mesh->VBO);
+    glGenBuffers(1, &this->mesh->EBO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+    glBindVertexArray(this->mesh->VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->mesh->VBO);
     glBufferData(
         GL_ARRAY_BUFFER,
-        sizeof(GL_FLOAT) * this->vertexData.size(),
-        this->vertexData.data(),
+        vertexBytes,
+        vertices,
+        GL_STATIC_DRAW);
+
+    // Indices (element buffer binding is stored in the VAO)
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->mesh->EBO);
+    glBufferData(
+        GL_ELEMENT_ARRAY_BUFFER,
+        sizeof(GLuint) * this->mesh->indexCount,
+        indices,
         GL_STATIC_DRAW);
 
-    // Vertices
-    glVertexAttribPointer(
-        0,
-        3,
-        GL_FLOAT,
-        GL_FALSE,
-        14 * sizeof(GL_FLOAT),
-        (void *)0);
-
-    // Normals
-    glVertexAttribPointer(
-        1,
-        3,
-        GL_FLOAT,
-        GL_FALSE,
-        14 * sizeof(GL_FLOAT),
-        (void *)normalPtr);
-
-    // Texture coordinates
-    glVertexAttribPointer(
-        2,
-        2,
-        GL_FLOAT,
-        GL_FALSE,
-        14 * sizeof(GL_FLOAT),
-        (void *)uvPtr);
-
-    // Tangents
-    glVertexAttribPointer(
-        3,
-        3,
-        GL_FLOAT,
-        GL_FALSE,
-        14 * sizeof(GL_FLOAT),
-        (void *)tangentPtr);
-
-    // Bitangents
-    glVertexAttribPointer(
-        4,
-        3,
-        GL_FLOAT,
-        GL_FALSE,
-        14 * sizeof(GL_FLOAT),
-        (void *)bitangentPtr);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
+    // Vertices, normals, texture coordinates and tangents
+    for (const VertexAttribute &attribute : this->layout)
+    {
+        glVertexAttribPointer(
+            attribute.location,
+            attribute.components,
+            attribute.type,
+            attribute.normalized,
+            this->mesh->vertexStride,
+            (void *)(GLintptr)attribute.offset);
+
+        glEnableVertexAttribArray(attribute.location);
+    }
+
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
-}
\ No newline at end of file
+    timer.stop();
+
+    // The GPU has its own copy now
+    this->meshCache.close();
+
+    if (this->releaseAfterUpload)
+        releaseGeometry();
+}
+
+void ModelClass::releaseGeometry()
+{
+    // Swapping with empty vectors, clear() alone keeps the capacity
+    std::vector<GLfloat>().swap(this->vertexData);
+    std::vector<GLuint>().swap(this->indexData);
+    std::vector<unsigned char>().swap(this->packedData);
+}
+
+void ModelClass::releaseResources()
+{
+    releaseGeometry();
+
+    this->mesh = std::make_shared<MeshAsset>();
+    this->ownsMeshData = false;
+    this->meshRegistered = false;
+    this->resident = false;
+    this->textures.clear();
+    this->textureArray.reset();
+    this->textureRequests.clear();
+    this->materialRequests.clear();
+}
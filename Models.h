@@ -4,49 +4,346 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glad/glad.h>
 
+#include "AssetRegistry.h"
+#include "BlockCompression.h"
+#include "MeshCache.h"
+#include "Meshlets.h"
+#include "TextureArrays.h"
+#include "TextureCache.h"
 
-
+#include <atomic>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
+// position (3), normal (3), uv (2), tangent (3) + handedness (1)
+const int FLOATS_PER_VERTEX = 12;
+
+// Quantized vertex: position as 4 x unorm16 within the mesh bounds,
+// normal and tangent as snorm 10_10_10_2, uv as 2 x half float
+const int PACKED_VERTEX_SIZE = 20;
+
+// Detail levels per mesh including the full one, each about half the previous
+const int MAX_LODS = 4;
+const float LOD_REDUCTION = 0.5f;
+// A level may deviate from the full mesh by this many pixels on screen
+const float LOD_PIXEL_ERROR = 1.0f;
+// Switching to a coarser level waits until its error is this fraction of the limit
+const float LOD_HYSTERESIS = 0.75f;
+
+// Streamed models moved to the GPU per frame, so swapping them in does not stall a frame
+const int MAX_UPLOADS_PER_FRAME = 1;
+
+// A texture attached to a model, decoded on the worker threads and uploaded later
+struct TextureRequest
+{
+	std::string path; // empty for materials without a texture
+	GLint format = 0;
+	// Whole file, when read ahead with the other textures; freed once decoded
+	std::vector<unsigned char> encoded;
+	// Null until decoded, and when the registry already had the texture.
+	// Images with a texture cache are mapped into cache instead.
+	std::shared_ptr<unsigned char> pixels;
+	std::shared_ptr<TextureCache> cache;
+	// Finest level uploaded, 0 unless the texture's mips are streamed
+	int residentLevel = 0;
+	int width = 0, height = 0, channels = 0;
+	// Size of the texture array layer the image goes to, 0 for a texture of its own
+	int layerWidth = 0, layerHeight = 0;
+	// Mip chain below pixels, uploaded with them when there is no cache
+	std::vector<MipLevel> levels;
+	// Normal maps hold vectors rather than sRGB colour, their mips are filtered as such
+	bool normalMap = false;
+	// Encodes the image to blocks, the format picked from its contents
+	bool compress = false;
+	// Layout of pixels and levels once decoded. Set beforehand for array
+	// layers, which take the array's format whatever the image holds.
+	BlockFormat blockFormat = BlockFormat::None;
+};
+
 class ModelClass
 {
 protected:
 	std::string objPath;
+	// unique interleaved vertices, referenced by indexData
 	std::vector<GLfloat> vertexData;
-	std::vector<GLuint> textures;
+	std::vector<GLuint> indexData;
+	// Base texture, then the normal map when withNormals is set
+	std::vector<TextureHandle> textures;
 	bool withNormals = false;
-	GLuint VAO, VBO;
+
+	// Shared array holding the base texture instead, in textureLayer (see TextureArrays.h)
+	std::shared_ptr<TextureArray> textureArray;
+	int textureLayer = -1;
+
+	// Textures attached but not uploaded yet, in the order of textures
+	std::vector<TextureRequest> textureRequests;
+	// Per material of the mesh, queued by the model that loads it
+	std::vector<TextureRequest> materialRequests;
+	// Internal format of the material textures, 0 when they are not wanted
+	GLint materialTextureFormat = 0;
+
+	// Set by the worker once the mesh and textures are decoded
+	std::atomic<bool> cpuReady{false};
+	// Set on the GL thread once this model's buffers and textures are uploaded
+	bool resident = false;
+
+	// Quantized copy of vertexData, uploaded instead of it when packedVertices is set
+	bool packedVertices = false;
+	// Sorts triangle clusters to cut overdraw after the vertex cache pass
+	bool overdrawOrdering = false;
+	// Splits submeshes into culling clusters, see Meshlets.h
+	bool meshletCulling = false;
+	// Frees vertexData, indexData and packedData once the buffers are uploaded
+	bool releaseAfterUpload = false;
+	// Uploads cached textures coarse levels first, see TextureStreaming.h
+	bool mipStreaming = false;
+	// Block-compresses the textures attached from now on, see BlockCompression.h
+	bool textureCompression = false;
+	std::vector<unsigned char> packedData;
+
+	// Vertex layout of the VBO, as stored in the mesh cache
+	std::vector<VertexAttribute> layout;
+
+	// Buffers and draw tables, shared with every model loaded from the same file
+	MeshHandle mesh;
+	// Set on the model that loaded the mesh, which is the one that uploads it
+	bool ownsMeshData = false;
+	// Set once mesh is the registry's, the workers only fill it from then on
+	bool meshRegistered = false;
+
+	// Level drawn last frame, the starting point for the next selection
+	int currentLod;
+	// Visible index ranges of one draw, kept to avoid allocating every frame
+	std::vector<GLsizei> drawCounts;
+	std::vector<const void*> drawOffsets;
+
+	// Precooked copy of the mesh, mapped until it is uploaded
+	MeshCache meshCache;
+
+	bool loadCache(uint64_t sourceHash);
+	void writeCache(uint64_t sourceHash);
+	std::string getCachePath();
+	// Registry key: the canonical .obj path plus the options that change the cooked mesh
+	std::string getMeshKey();
+	// Takes the mesh another model registered under the same key, or registers
+	// this model's own. Runs on the drawing thread before the loading starts,
+	// so the workers never swap mesh while it is being drawn.
+	void registerMesh();
+
+	// Appends simplified copies of the submeshes as levels 1..MAX_LODS-1
+	void buildLods();
+
+	// Vertex cache, overdraw (or meshlet) and vertex fetch passes over the indexed mesh
+	void optimizeMesh();
+
+	// Fills packedData and switches the layout to the quantized format
+	void packVertices();
+	// Bytes handed to glBufferData (and written to the cache)
+	const void* getUploadVertices();
+
+	// Screen pixels per object-space unit at the mesh's centre, FLT_MAX when it reaches the near plane
+	float pixelsPerUnit(const glm::mat4& transform, const glm::mat4& projection, const glm::mat4& view, float viewportHeight);
+
+	/// <summary>
+	/// Picks the coarsest level whose error stays under LOD_PIXEL_ERROR once
+	/// projected to the screen (pixelsPerUnit), moving at most as far as the
+	/// hysteresis allows.
+	/// </summary>
+	int selectLod(float pixelsPerUnit);
+
+	// Asks the texture streamer for the mip levels of every texture of the
+	// model at this size on screen (FLT_MAX for full detail)
+	void requestTextureDetail(float pixelsPerUnit);
+
+	// Binds the base texture on GL_TEXTURE0 and the normal map on GL_TEXTURE1,
+	// or only selects the layer when the base texture is in a texture array
+	void bindTextures(GLuint shaderProgram);
+
+	// Draws every submesh of a level, binding each material's texture on GL_TEXTURE0.
+	// Also sets the uniforms objVert.vert needs to decode packed positions.
+	// With a culler only the meshlets it finds visible are submitted.
+	void drawSubmeshes(GLuint shaderProgram, int lod = 0, const MeshletCuller* culler = nullptr);
+
+	// Adds a request per material texture of the mesh, if this model loaded it
+	void queueMaterialTextures();
+	// Loads the mesh, then reads and decodes the material textures it names
+	void loadWithMaterials();
+	// Reads the files of every texture the models still have to decode in one
+	// batch, once per texture however many models ask for it
+	static void readTextureFiles(const std::vector<ModelClass*>& models);
+	/// <summary>
+	/// Decodes every attached texture the registry does not hold yet, one
+	/// image per worker job, and marks each model cpuReady once its last
+	/// image is done. Requests for the same texture share one decode.
+	/// With loadMeshes each model's mesh is loaded by a job of its own ahead
+	/// of its images, its material textures read and decoded right after.
+	/// Needs no GL context.
+	/// </summary>
+	static void decodeTextureFiles(const std::vector<ModelClass*>& models, bool loadMeshes = false);
+	// Turns the texture requests into textures, on the GL thread
+	void uploadTextures();
+	// Uploads whatever the worker prepared and marks the model resident
+	void finishLoading();
+
+	/// <summary>
+	/// Until the model is resident, draws the placeholder (a box over the
+	/// mesh bounds with a 1x1 texture) and returns true. The caller's
+	/// transform uniform must already be set. Nothing is drawn while the
+	/// bounds are still unknown.
+	/// </summary>
+	bool drawPlaceholder(GLuint shaderProgram);
 
 public:
 	inline ModelClass(std::string path) : objPath(path),
-		VAO(NULL),
-		VBO(NULL) {}
+		mesh(std::make_shared<MeshAsset>()),
+		currentLod(0) {}
+
+	// Selects the quantized vertex format, must be called before loadObj
+	inline void usePackedVertices(bool packed)
+	{
+		this->packedVertices = packed;
+	}
+
+	// Enables the overdraw-aware cluster ordering, must be called before loadObj
+	inline void useOverdrawOrdering(bool ordering)
+	{
+		this->overdrawOrdering = ordering;
+	}
 
+	// Builds meshlets for per-frame frustum and back-face culling, must be called before loadObj
+	inline void useMeshletCulling(bool culling)
+	{
+		this->meshletCulling = culling;
+	}
+
+	// Drops the CPU copy of the geometry after createVAO_VBO, keeping only
+	// counts, bounds, layout and the submesh tables
+	inline void useReleaseAfterUpload(bool release)
+	{
+		this->releaseAfterUpload = release;
+	}
+
+	// Streams the finer mip levels of cached textures in only once the model
+	// is big enough on screen, must be called before the textures are uploaded
+	inline void useMipStreaming(bool streaming)
+	{
+		this->mipStreaming = streaming;
+	}
+
+	// Stores textures as BC1 (opaque), BC3 (with alpha) or BC5 (normal maps),
+	// encoded into their texture caches once. Must be called before attaching
+	// them, and only when blockCompressionSupported().
+	inline void useTextureCompression(bool compression)
+	{
+		this->textureCompression = compression;
+	}
+
+	/// <summary>
+	/// Puts the base texture into a layer of a shared texture array rather
+	/// than a texture of its own, resampled to the array's size if needed.
+	/// Should the image come out in another block format than the array's,
+	/// the model drops the array and uploads it as a texture of its own.
+	/// The array must be bound on the unit of the texArray sampler when drawing.
+	/// </summary>
+	void useTextureArray(const std::shared_ptr<TextureArray>& array, int layer);
+
+	/// <summary>
+	/// Groups the models by the size of their base texture, read from the
+	/// image headers, and gives each size shared by two or more of them a
+	/// texture array of exactly that size. Models alone in their size (or
+	/// whose image cannot be read) keep a texture of their own. Compressed
+	/// arrays are BC1 when every layer is opaque, BC3 otherwise. Must be
+	/// called on the GL thread, after the base textures are attached.
+	/// </summary>
+	static std::vector<std::shared_ptr<TextureArray>> shareTextureArrays(const std::vector<ModelClass*>& models,
+		bool streamed, bool compress);
+
+	inline const std::shared_ptr<TextureArray>& getTextureArray() const
+	{
+		return this->textureArray;
+	}
+
+	/// <summary>
+	/// Shares the mesh of another model loaded from the same file with the
+	/// same options. Otherwise loads it from its precooked cache
+	/// (objPath + ".mesh") when that matches the source file, or parses the
+	/// OBJ and writes the cache. loadAll and streamAll register the meshes
+	/// before handing this to the workers.
+	/// </summary>
 	void loadObj();
 
+	/// <summary>
+	/// Loads every model on the worker threads (parse, tangents, vertex assembly).
+	/// Each file is loaded once, models repeating it share the result.
+	/// Needs no GL context, so it can run before the window exists.
+	/// </summary>
+	static void loadAll(const std::vector<ModelClass*>& models);
+
+	// Uploads every model's buffers and textures, must run on the GL context thread
+	static void createAll(const std::vector<ModelClass*>& models);
+
+	/// <summary>
+	/// Loads the models and decodes their textures on a background thread
+	/// and returns at once, model by model so the first ones are ready while
+	/// later ones still load. Models draw as placeholders until uploadReady
+	/// has swapped them in. Options and textures must be attached before the call.
+	/// </summary>
+	static std::future<void> streamAll(const std::vector<ModelClass*>& models);
+
+	// Uploads up to maxUploads streamed models that are ready, on the GL thread.
+	// Returns true once every model is resident.
+	static bool uploadReady(const std::vector<ModelClass*>& models, int maxUploads = MAX_UPLOADS_PER_FRAME);
+
+	// Textures are decoded and uploaded by createAll, or streamed by streamAll
 	void attachTexture(std::string texPath, GLint format);
 	void attachNormalTexture(std::string texPath, GLint format);
+	// Adds the diffuse textures named by the .obj's materials, once it is loaded
+	void attachMaterialTextures(GLint format);
+	// Uploads the mesh, a no-op on models sharing one loaded by another model
 	void createVAO_VBO();
 
+	// Frees the CPU-side vertices and indices, the GL buffers are unaffected
+	void releaseGeometry();
+
+	// Drops this model's mesh and texture handles, freeing the GL objects no
+	// other model uses. Must run while the GL context is still current.
+	void releaseResources();
+
+	inline bool isResident()
+	{
+		return this->resident && this->mesh->VAO != 0;
+	}
+
 	inline GLuint getVAO()
 	{
-		return this->VAO;
+		return this->mesh->VAO;
 	}
 
 	inline GLuint getBaseTexture()
 	{
-		return this->textures[0];
+		return this->textures[0]->id;
 	}
 
 	inline GLuint getNormals()
 	{
-		return this->textures[1];
+		return this->textures[1]->id;
+	}
+
+	inline GLsizei getIndexCount()
+	{
+		return this->mesh->indexCount;
+	}
+
+	inline glm::vec3 getBoundsMin()
+	{
+		return this->mesh->boundsMin;
 	}
 
-	inline std::vector<GLfloat> getVertexData()
+	inline glm::vec3 getBoundsMax()
 	{
-		return this->vertexData;
+		return this->mesh->boundsMax;
 	}
 };
 
@@ -0,0 +1,434 @@
+#include "ObjReader.h"
+#include "Jobs.h"
+#include "AssetPack.h"
+
+#include <algorithm>
+#include <charconv>
+#include <map>
+#include <unordered_map>
+
+namespace
+{
+	// Below this a file is parsed in one piece
+	const size_t MIN_CHUNK_SIZE = 128 * 1024;
+
+	// Index as written in the file, relative ones (negative) are resolved after the merge
+	struct RawCorner
+	{
+		int index[3]; // position, texcoord, normal
+		unsigned char relative; // bit per attribute
+	};
+
+	enum class MarkerKind
+	{
+		MATERIAL,
+		SHAPE,
+		LIBRARY
+	};
+
+	// usemtl / o / g / mtllib, in file order relative to the chunk's corners
+	struct Marker
+	{
+		MarkerKind kind;
+		std::string name;
+		size_t corner;
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+		std::vector<float> positions;
+		std::vector<float> normals;
+		std::vector<float> texcoords;
+		std::vector<RawCorner> corners;
+		std::vector<Marker> markers;
+	};
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	inline const char* skipSpaces(const char* p, const char* end)
+	{
+		while (p < end && isSpace(*p))
+			p++;
+		return p;
+	}
+
+	inline const char* lineEnd(const char* p, const char* end)
+	{
+		while (p < end && *p != '\n')
+			p++;
+		return p;
+	}
+
+	// Reads up to count floats, missing ones are left at zero
+	inline void parseFloats(const char* p, const char* end, float* values, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			p = skipSpaces(p, end);
+			values[i] = 0.0f;
+
+			if (p >= end)
+				continue;
+
+			// from_chars does not accept a leading '+'
+			if (*p == '+')
+				p++;
+
+			std::from_chars_result result = std::from_chars(p, end, values[i]);
+			p = result.ptr;
+		}
+	}
+
+	// Rest of the line without surrounding whitespace
+	inline std::string parseName(const char* p, const char* end)
+	{
+		p = skipSpaces(p, end);
+
+		while (end > p && (isSpace(end[-1]) || end[-1] == '\r'))
+			end--;
+
+		return std::string(p, end);
+	}
+
+	// One "v", "v/t", "v//n" or "v/t/n" group
+	inline const char* parseCorner(const char* p, const char* end, RawCorner& corner)
+	{
+		corner = {{0, 0, 0}, 0};
+
+		for (int attribute = 0; attribute < 3 && p < end && !isSpace(*p) && *p != '\r'; attribute++)
+		{
+			if (*p != '/')
+			{
+				int value = 0;
+				std::from_chars_result result = std::from_chars(p, end, value);
+				p = result.ptr;
+
+				if (value < 0)
+				{
+					corner.index[attribute] = value;
+					corner.relative |= 1 << attribute;
+				}
+				else
+				{
+					corner.index[attribute] = value;
+				}
+			}
+
+			if (p < end && *p == '/')
+				p++;
+		}
+
+		// Stepping past anything unexpected so the caller always advances
+		while (p < end && !isSpace(*p) && *p != '\r')
+			p++;
+
+		return p;
+	}
+
+	void parseChunk(Chunk& chunk)
+	{
+		const char* p = chunk.begin;
+		const char* end = chunk.end;
+		std::vector<RawCorner> polygon;
+
+		while (p < end)
+		{
+			const char* eol = lineEnd(p, end);
+			const char* line = skipSpaces(p, eol);
+			p = eol + 1;
+
+			if (line >= eol || *line == '#')
+				continue;
+
+			if (line[0] == 'v' && eol - line > 1)
+			{
+				if (isSpace(line[1]))
+				{
+					float values[3];
+					parseFloats(line + 2, eol, values, 3);
+					chunk.positions.insert(chunk.positions.end(), values, values + 3);
+				}
+				else if (line[1] == 'n')
+				{
+					float values[3];
+					parseFloats(line + 2, eol, values, 3);
+					chunk.normals.insert(chunk.normals.end(), values, values + 3);
+				}
+				else if (line[1] == 't')
+				{
+					float values[2];
+					parseFloats(line + 2, eol, values, 2);
+					chunk.texcoords.insert(chunk.texcoords.end(), values, values + 2);
+				}
+			}
+			else if (line[0] == 'f' && eol - line > 1 && isSpace(line[1]))
+			{
+				// Attribute counts so far, relative indices count back from these
+				int counts[3] = {
+					(int)chunk.positions.size() / 3,
+					(int)chunk.texcoords.size() / 2,
+					(int)chunk.normals.size() / 3};
+
+				polygon.clear();
+				const char* q = skipSpaces(line + 1, eol);
+
+				while (q < eol && *q != '\r')
+				{
+					RawCorner corner;
+					q = parseCorner(q, eol, corner);
+					q = skipSpaces(q, eol);
+
+					// Relative indices become chunk-local (0-based), absolute ones 0-based
+					for (int attribute = 0; attribute < 3; attribute++)
+					{
+						if (corner.relative & (1 << attribute))
+							corner.index[attribute] += counts[attribute];
+						else
+							corner.index[attribute] -= 1;
+					}
+
+					polygon.push_back(corner);
+				}
+
+				// Triangle fan over the polygon
+				for (size_t i = 2; i < polygon.size(); i++)
+				{
+					chunk.corners.push_back(polygon[0]);
+					chunk.corners.push_back(polygon[i - 1]);
+					chunk.corners.push_back(polygon[i]);
+				}
+			}
+			else if (eol - line > 6 && std::equal(line, line + 6, "usemtl"))
+			{
+				chunk.markers.push_back({MarkerKind::MATERIAL, parseName(line + 6, eol), chunk.corners.size()});
+			}
+			else if (eol - line > 6 && std::equal(line, line + 6, "mtllib"))
+			{
+				chunk.markers.push_back({MarkerKind::LIBRARY, parseName(line + 6, eol), chunk.corners.size()});
+			}
+			else if ((line[0] == 'o' || line[0] == 'g') && (eol - line == 1 || isSpace(line[1]) || line[1] == '\r'))
+			{
+				chunk.markers.push_back({MarkerKind::SHAPE, std::string(), chunk.corners.size()});
+			}
+		}
+	}
+
+	// newmtl / map_Kd pairs, in file order
+	void readMtl(const std::string& path,
+		const std::string& baseDir,
+		std::map<std::string, int>& materialIds,
+		std::vector<std::string>& textures)
+	{
+		AssetFile file;
+
+		if (!file.open(path))
+			return;
+
+		const char* p = (const char*)file.data();
+		const char* end = p + file.size();
+		int current = -1;
+
+		while (p < end)
+		{
+			const char* eol = lineEnd(p, end);
+			const char* line = skipSpaces(p, eol);
+			p = eol + 1;
+
+			if (eol - line > 6 && std::equal(line, line + 6, "newmtl"))
+			{
+				std::string name = parseName(line + 6, eol);
+				auto found = materialIds.find(name);
+
+				if (found == materialIds.end())
+				{
+					found = materialIds.emplace(name, (int)textures.size()).first;
+					textures.emplace_back();
+				}
+
+				current = found->second;
+			}
+			else if (current >= 0 && eol - line > 6 && std::equal(line, line + 6, "map_Kd"))
+			{
+				// Options come first, the file name is the last token
+				std::string value = parseName(line + 6, eol);
+				size_t space = value.find_last_of(" \t");
+				textures[current] = baseDir + (space == std::string::npos ? value : value.substr(space + 1));
+			}
+		}
+	}
+}
+
+bool readObj(const std::string& path, ObjData& data, std::string& error)
+{
+	AssetFile file;
+
+	if (!file.open(path))
+	{
+		error = "Cannot open file [" + path + "]";
+		return false;
+	}
+
+	// ---------------------------------------------------
+	// PARSING CHUNKS
+	// Chunks end on a line break so every line belongs to exactly one of them
+	const char* begin = (const char*)file.data();
+	const char* end = begin + file.size();
+
+	size_t chunkCount = std::max<size_t>(1, std::min<size_t>(workerCount(), file.size() / MIN_CHUNK_SIZE));
+	std::vector<Chunk> chunks(chunkCount);
+
+	const char* chunkBegin = begin;
+
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		const char* chunkEnd = i + 1 == chunkCount ? end : begin + file.size() * (i + 1) / chunkCount;
+		chunkEnd = std::min(end, lineEnd(std::max(chunkBegin, chunkEnd), end) + 1);
+
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	parallelFor(chunks.size(), [&](size_t i)
+		{ parseChunk(chunks[i]); });
+
+	// ---------------------------------------------------
+	// MERGING
+	size_t positionCount = 0, texcoordCount = 0, normalCount = 0;
+
+	for (const Chunk& chunk : chunks)
+	{
+		positionCount += chunk.positions.size();
+		texcoordCount += chunk.texcoords.size();
+		normalCount += chunk.normals.size();
+	}
+
+	data = ObjData();
+	data.positions.reserve(positionCount);
+	data.texcoords.reserve(texcoordCount);
+	data.normals.reserve(normalCount);
+
+	std::string baseDir = path.substr(0, path.find_last_of("/\\") + 1);
+	std::map<std::string, int> materialIds;
+
+	// Corners per (shape, material) piece, in order of first appearance
+	std::map<std::pair<int, int>, size_t> pieceOf;
+	std::vector<SubMesh> pieces;
+	std::vector<std::vector<ObjCorner>> pieceCorners;
+
+	int shape = 0;
+	int material = -1;
+
+	for (const Chunk& chunk : chunks)
+	{
+		int base[3] = {
+			(int)data.positions.size() / 3,
+			(int)data.texcoords.size() / 2,
+			(int)data.normals.size() / 3};
+
+		data.positions.insert(data.positions.end(), chunk.positions.begin(), chunk.positions.end());
+		data.texcoords.insert(data.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+		data.normals.insert(data.normals.end(), chunk.normals.begin(), chunk.normals.end());
+
+		int limit[3] = {
+			(int)data.positions.size() / 3,
+			(int)data.texcoords.size() / 2,
+			(int)data.normals.size() / 3};
+
+		size_t marker = 0;
+
+		for (size_t i = 0; i <= chunk.corners.size(); i += 3)
+		{
+			// Applying the usemtl / o / g / mtllib lines that came before this triangle
+			for (; marker < chunk.markers.size() && chunk.markers[marker].corner <= i; marker++)
+			{
+				const Marker& current = chunk.markers[marker];
+
+				if (current.kind == MarkerKind::SHAPE)
+				{
+					shape++;
+				}
+				else if (current.kind == MarkerKind::LIBRARY)
+				{
+					readMtl(baseDir + current.name, baseDir, materialIds, data.materialTextures);
+				}
+				else
+				{
+					auto found = materialIds.find(current.name);
+					material = found == materialIds.end() ? -1 : found->second;
+				}
+			}
+
+			if (i == chunk.corners.size())
+				break;
+
+			ObjCorner triangle[3];
+			bool valid = true;
+
+			for (int c = 0; c < 3; c++)
+			{
+				const RawCorner& raw = chunk.corners[i + c];
+				int resolved[3];
+
+				for (int attribute = 0; attribute < 3; attribute++)
+				{
+					resolved[attribute] = raw.index[attribute] + ((raw.relative & (1 << attribute)) ? base[attribute] : 0);
+
+					if (resolved[attribute] < 0 || resolved[attribute] >= limit[attribute])
+						resolved[attribute] = -1;
+				}
+
+				triangle[c] = {resolved[0], resolved[1], resolved[2]};
+				valid = valid && resolved[0] >= 0;
+			}
+
+			if (!valid)
+				continue;
+
+			auto found = pieceOf.find(std::make_pair(shape, material));
+
+			if (found == pieceOf.end())
+			{
+				found = pieceOf.emplace(std::make_pair(shape, material), pieces.size()).first;
+				pieces.push_back({0, 0, material});
+				pieceCorners.emplace_back();
+			}
+
+			pieceCorners[found->second].insert(pieceCorners[found->second].end(), triangle, triangle + 3);
+		}
+	}
+
+	// ---------------------------------------------------
+	// SUBMESHES
+	// Packing the pieces material by material, shapes keep their file order
+	std::vector<size_t> pieceOrder(pieces.size());
+
+	for (size_t i = 0; i < pieceOrder.size(); i++)
+		pieceOrder[i] = i;
+
+	std::stable_sort(pieceOrder.begin(), pieceOrder.end(), [&](size_t a, size_t b)
+		{ return pieces[a].materialId < pieces[b].materialId; });
+
+	for (size_t piece : pieceOrder)
+	{
+		SubMesh submesh = pieces[piece];
+		submesh.indexOffset = (uint32_t)data.corners.size();
+		submesh.indexCount = (uint32_t)pieceCorners[piece].size();
+		data.submeshes.push_back(submesh);
+
+		data.corners.insert(data.corners.end(), pieceCorners[piece].begin(), pieceCorners[piece].end());
+	}
+
+	if (data.corners.empty())
+	{
+		error = "No faces in [" + path + "]";
+		return false;
+	}
+
+	return true;
+}
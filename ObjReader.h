@@ -0,0 +1,35 @@
+#pragma once
+#include "MeshCache.h"
+
+#include <string>
+#include <vector>
+
+// Attribute indices of one triangle corner, -1 when the attribute is missing
+struct ObjCorner
+{
+	int position;
+	int texcoord;
+	int normal;
+};
+
+/// <summary>
+/// Parsed .obj contents, already triangulated and packed by material.
+/// corners holds three entries per triangle in the order of the submesh table.
+/// </summary>
+struct ObjData
+{
+	std::vector<float> positions; // x, y, z
+	std::vector<float> normals;   // x, y, z
+	std::vector<float> texcoords; // u, v
+	std::vector<ObjCorner> corners;
+	std::vector<SubMesh> submeshes;
+	// Diffuse texture per material (relative to the working directory), empty when it has none
+	std::vector<std::string> materialTextures;
+};
+
+/// <summary>
+/// Reads an .obj (and the .mtl it names) straight from a memory mapping.
+/// Large files are split at line boundaries and parsed on the worker threads.
+/// Every shape is split into one submesh per material, sorted by material.
+/// </summary>
+bool readObj(const std::string& path, ObjData& data, std::string& error);
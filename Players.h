@@ -3,6 +3,7 @@
 #include "Models.h"
 #include "light.h"
 #include <GLFW/glfw3.h>
+#include <cfloat>
 /// <summary>
 /// builder classes allow you to chain methods. similar to java builder classes
 /// </summary>
@@ -82,7 +83,7 @@ public:
 	void draw(GLuint shaderProgram)
 	{
 		glUseProgram(shaderProgram);
-		glBindVertexArray(this->VAO);
+		glBindVertexArray(this->mesh->VAO);
 
 		// Initialize transformation matrix, and assign position, scaling, and rotation
 		transformationMatrix = glm::translate(glm::mat4(1),
@@ -108,21 +109,18 @@ public:
 		unsigned int transformationLoc = glGetUniformLocation(shaderProgram, "transform");
 		glUniformMatrix4fv(transformationLoc, 1, GL_FALSE, glm::value_ptr(transformationMatrix));
 
-		glActiveTexture(GL_TEXTURE0);
-		GLuint tex0Address = glGetUniformLocation(shaderProgram, "tex0");
-		glBindTexture(GL_TEXTURE_2D, this->textures[0]);
-		glUniform1i(tex0Address, 0);
+		// Still streaming in
+		if (drawPlaceholder(shaderProgram))
+			return;
 
-		if (withNormals)
-		{
-			glActiveTexture(GL_TEXTURE1);
-			GLuint tex1Address = glGetUniformLocation(shaderProgram, "norm_tex");
-			glBindTexture(GL_TEXTURE_2D, this->textures[1]);
-			glUniform1i(tex1Address, 1);
-		}
+		bindTextures(shaderProgram);
+
+		// Always close to the camera, so every level is wanted (textures
+		// started coarse over budget sharpen once there is room)
+		requestTextureDetail(FLT_MAX);
 
 		// Draw
-		glDrawArrays(GL_TRIANGLES, 0, this->vertexData.size() / 5);
+		drawSubmeshes(shaderProgram);
 	}
 
 	float getDepth()
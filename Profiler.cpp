@@ -0,0 +1,127 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct PhaseSample
+	{
+		std::string asset;
+		std::string phase;
+		double startMs;
+		double ms;
+	};
+
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	std::mutex samplesMutex;
+	std::vector<PhaseSample> samples;
+
+	// Paths may hold backslashes on Windows
+	std::string jsonString(const std::string& text)
+	{
+		std::string quoted = "\"";
+
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				quoted += '\\';
+
+			quoted += c;
+		}
+
+		return quoted + "\"";
+	}
+}
+
+void StartupProfiler::record(const std::string& asset, const char* phase, double startMs, double ms)
+{
+	std::lock_guard<std::mutex> lock(samplesMutex);
+	samples.push_back({asset, phase, startMs, ms});
+}
+
+double StartupProfiler::now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void StartupProfiler::report(const std::string& jsonPath)
+{
+	std::vector<PhaseSample> sorted;
+	{
+		std::lock_guard<std::mutex> lock(samplesMutex);
+		sorted.swap(samples);
+	}
+
+	std::stable_sort(sorted.begin(), sorted.end(), [](const PhaseSample& a, const PhaseSample& b)
+		{ return a.ms > b.ms; });
+
+	double totalMs = StartupProfiler::now();
+
+	// ---------------------------------------------------
+	// TABLE
+	std::map<std::string, double> phaseTotals;
+
+	std::printf("Startup took %.1f ms\n", totalMs);
+	std::printf("%-48s %-16s %10s %10s\n", "asset", "phase", "start ms", "ms");
+
+	for (const PhaseSample& sample : sorted)
+	{
+		std::printf("%-48s %-16s %10.1f %10.2f\n", sample.asset.c_str(), sample.phase.c_str(), sample.startMs, sample.ms);
+		phaseTotals[sample.phase] += sample.ms;
+	}
+
+	// Summed across threads, so these can add up to more than the startup time
+	std::printf("%-48s %-16s %10s %10s\n", "total per phase", "", "", "");
+
+	for (const auto& total : phaseTotals)
+		std::printf("%-48s %-16s %10s %10.2f\n", "", total.first.c_str(), "", total.second);
+
+	// ---------------------------------------------------
+	// JSON
+	FILE* file = std::fopen(jsonPath.c_str(), "w");
+
+	if (!file)
+	{
+		std::printf("Could not write %s\n", jsonPath.c_str());
+		return;
+	}
+
+	std::fprintf(file, "{\n  \"totalMs\": %.3f,\n  \"phases\": [", totalMs);
+
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		std::fprintf(file, "%s\n    {\"asset\": %s, \"phase\": %s, \"startMs\": %.3f, \"ms\": %.3f}",
+			i == 0 ? "" : ",",
+			jsonString(sorted[i].asset).c_str(),
+			jsonString(sorted[i].phase).c_str(),
+			sorted[i].startMs,
+			sorted[i].ms);
+	}
+
+	std::fprintf(file, "\n  ]\n}\n");
+	std::fclose(file);
+}
+
+PhaseTimer::PhaseTimer(const std::string& asset, const char* phase)
+	: asset(asset), phase(phase), startMs(StartupProfiler::now()), running(true)
+{
+}
+
+PhaseTimer::~PhaseTimer()
+{
+	stop();
+}
+
+void PhaseTimer::stop()
+{
+	if (!this->running)
+		return;
+
+	this->running = false;
+	StartupProfiler::record(this->asset, this->phase, this->startMs, StartupProfiler::now() - this->startMs);
+}
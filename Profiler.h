@@ -0,0 +1,41 @@
+#pragma once
+#include <chrono>
+#include <string>
+
+/// <summary>
+/// Collects the wall time of every startup phase (parsing, decoding,
+/// uploads, shader builds...) per asset, from any thread. GL phases are
+/// timed on the CPU side only: the driver may finish the work later.
+/// </summary>
+class StartupProfiler
+{
+public:
+	static void record(const std::string& asset, const char* phase, double startMs, double ms);
+
+	// Milliseconds since the program started
+	static double now();
+
+	/// <summary>
+	/// Prints every phase, slowest first, with totals per phase, and writes
+	/// the same samples to jsonPath. Phases recorded later are kept for the next report.
+	/// </summary>
+	static void report(const std::string& jsonPath);
+};
+
+/// <summary>
+/// Times one phase of one asset, from construction until stop() or destruction.
+/// </summary>
+class PhaseTimer
+{
+private:
+	std::string asset;
+	const char* phase;
+	double startMs;
+	bool running;
+
+public:
+	PhaseTimer(const std::string& asset, const char* phase);
+	~PhaseTimer();
+
+	void stop();
+};
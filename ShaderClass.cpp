@@ -1,24 +1,27 @@
 
 #include "ShaderClass.h"
+#include "BatchReader.h"
+#include "Profiler.h"
 
 //gets uniform location
 
 ShaderClass::ShaderClass(std::string vertPath, std::string fragPath) {
+	// Read both sources in one batch, missing files come back empty
+	std::vector<FileRead> sources(2);
+	sources[0].path = vertPath;
+	sources[1].path = fragPath;
+	readBatch(sources);
+
 	// Load .vert file
-	std::fstream vertSrc(vertPath);
-	std::stringstream vertBuff;
-	vertBuff << vertSrc.rdbuf();
-	std::string vertS = vertBuff.str();
+	std::string vertS(sources[0].bytes.begin(), sources[0].bytes.end());
 	const char* v = vertS.c_str();
 
 	// Load .frag file
-	std::fstream fragSrc(fragPath);
-	std::stringstream fragBuff;
-	fragBuff << fragSrc.rdbuf();
-	std::string fragS = fragBuff.str();
+	std::string fragS(sources[1].bytes.begin(), sources[1].bytes.end());
 	const char* f = fragS.c_str();
 
 	// Compile vertex shader
+	PhaseTimer compileTimer(vertPath + " + " + fragPath, "shader compile");
 	GLuint vertShader = glCreateShader(GL_VERTEX_SHADER);
 	glShaderSource(vertShader, 1, &v, NULL);
 	glCompileShader(vertShader);
@@ -27,8 +30,10 @@ ShaderClass::ShaderClass(std::string vertPath, std::string fragPath) {
 	GLuint fragShader = glCreateShader(GL_FRAGMENT_SHADER);
 	glShaderSource(fragShader, 1, &f, NULL);
 	glCompileShader(fragShader);
+	compileTimer.stop();
 
 	// Create shader program and link both vertex and fragment shaders
+	PhaseTimer linkTimer(vertPath + " + " + fragPath, "shader link");
 	this->shaderProgram = glCreateProgram();
 	glAttachShader(this->shaderProgram, vertShader);
 	glAttachShader(this->shaderProgram, fragShader);
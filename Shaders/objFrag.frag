@@ -5,6 +5,9 @@ in vec3 fragPos;
 
 uniform sampler2D tex0;
 uniform sampler2D norm_tex;
+// Layer of the model's base texture in texArray, -1 to sample tex0
+uniform sampler2DArray texArray;
+uniform int texLayer;
 uniform vec3 eyePos;
 
 void attenuate(out float val, in float dist) {
@@ -86,10 +89,13 @@ in vec3 normCoord;
 out vec4 FragColor;
 uniform bool fgState;
 void main() {
-	vec4 pixelColor = texture(tex0, texCoord);
+	vec4 pixelColor = texLayer >= 0
+		? texture(texArray, vec3(texCoord, texLayer))
+		: texture(tex0, texCoord);
 
-	vec3 normal = texture(norm_tex, texCoord).rgb;
-	normal = normalize(normal * 2.0 - 1.0);
+	// Normal maps may be BC5, which only keeps x and y
+	vec2 normalXY = texture(norm_tex, texCoord).rg * 2.0 - 1.0;
+	vec3 normal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
 	normal = normalize(TBN * normal);
 
 	vec3 norms = normCoord;
@@ -3,23 +3,29 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 vertexNormal;
 layout (location = 2) in vec2 aTex;
-layout (location = 3) in vec3 m_tan;
-layout (location = 4) in vec3 m_btan;
+// xyz tangent, w handedness of the bitangent
+layout (location = 3) in vec4 m_tan;
 
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 transform;
 
+// Packed meshes store positions as 0..1 across their bounds
+uniform vec3 posOffset;
+uniform vec3 posScale;
+
 out vec2 texCoord;
 out vec3 normCoord;
 out vec3 fragPos;
 out mat3 TBN;
 
 void main(){
+	vec3 position = posOffset + aPos * posScale;
+
 	gl_Position = projection *
 					view *
 					transform *
-					vec4(aPos, 1.0);
+					vec4(position, 1.0);
 	
 	texCoord = aTex;
 
@@ -31,11 +37,11 @@ void main(){
 
 	normCoord = modelMat * vertexNormal;
 
-	vec3 T = normalize(modelMat * m_tan);
-	vec3 B = normalize(modelMat * m_btan);
+	vec3 T = normalize(modelMat * m_tan.xyz);
 	vec3 N = normalize(normCoord);
+	vec3 B = cross(N, T) * m_tan.w;
 
 	TBN = mat3(T, B, N);
 
-	fragPos = vec3(transform* vec4(aPos, 1.0));
+	fragPos = vec3(transform* vec4(position, 1.0));
 }
\ No newline at end of file
@@ -5,7 +5,7 @@ void OrthoCamera::kbCallBack(GLFWwindow* window, int key, int scancode, int acti
 	glm::vec3 right = glm::cross(this->worldUp, this->forward);
 	glm::vec3 move = glm::vec3(0);
 	Handler* hand = (Handler*)glfwGetWindowUserPointer(window);
-	PlayerClass player = *(hand->player);
+	PlayerClass* player = hand->player;
 
 	switch (key)
 	{
@@ -21,9 +21,9 @@ void OrthoCamera::kbCallBack(GLFWwindow* window, int key, int scancode, int acti
 
 		break;
 	case GLFW_KEY_2:
-		this->cameraCenter = player.playerPos;
-		this->cameraPos.x = player.playerPos.x;
-		this->cameraPos.z = player.playerPos.z;
+		this->cameraCenter = player->playerPos;
+		this->cameraPos.x = player->playerPos.x;
+		this->cameraPos.z = player->playerPos.z;
 		this->setView();
 
 		break;
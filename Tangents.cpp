@@ -0,0 +1,140 @@
+#include "Tangents.h"
+#include "Jobs.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+	// Work items below this size are not worth a thread
+	const size_t PARALLEL_BLOCK = 4096;
+
+	// Splits [0, count) into blocks and runs them on the worker threads
+	template <typename Job>
+	void forBlocks(size_t count, const Job& job)
+	{
+		size_t blocks = (count + PARALLEL_BLOCK - 1) / PARALLEL_BLOCK;
+
+		parallelFor(blocks, [&](size_t block)
+			{
+				size_t begin = block * PARALLEL_BLOCK;
+				size_t end = std::min(count, begin + PARALLEL_BLOCK);
+				job(begin, end);
+			});
+	}
+}
+
+void generateTangents(GLfloat* vertices,
+	size_t vertexCount,
+	const GLuint* indices,
+	size_t indexCount,
+	const TangentLayout& layout)
+{
+	size_t triangleCount = indexCount / 3;
+
+	auto vertex = [&](GLuint index)
+	{
+		return vertices + (size_t)index * layout.stride;
+	};
+
+	// ---------------------------------------------------
+	// FACE TANGENTS
+	// Left unnormalized so bigger triangles weigh more in the average
+	std::vector<glm::vec3> faceTangents(triangleCount);
+	std::vector<glm::vec3> faceBitangents(triangleCount);
+
+	forBlocks(triangleCount, [&](size_t begin, size_t end)
+		{
+			for (size_t t = begin; t < end; t++)
+			{
+				const GLfloat* v1 = vertex(indices[t * 3]);
+				const GLfloat* v2 = vertex(indices[t * 3 + 1]);
+				const GLfloat* v3 = vertex(indices[t * 3 + 2]);
+
+				glm::vec3 deltaPos1 = glm::make_vec3(v2) - glm::make_vec3(v1);
+				glm::vec3 deltaPos2 = glm::make_vec3(v3) - glm::make_vec3(v1);
+
+				glm::vec2 deltaUV1 = glm::make_vec2(v2 + layout.uvOffset) - glm::make_vec2(v1 + layout.uvOffset);
+				glm::vec2 deltaUV2 = glm::make_vec2(v3 + layout.uvOffset) - glm::make_vec2(v1 + layout.uvOffset);
+
+				float det = (deltaUV1.x * deltaUV2.y) - (deltaUV1.y * deltaUV2.x);
+
+				// Degenerate UVs give no usable direction
+				if (glm::abs(det) < 1e-12f)
+				{
+					faceTangents[t] = glm::vec3(0.0f);
+					faceBitangents[t] = glm::vec3(0.0f);
+					continue;
+				}
+
+				float r = 1.0f / det;
+
+				faceTangents[t] = r * (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y);
+				faceBitangents[t] = r * (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x);
+			}
+		});
+
+	// ---------------------------------------------------
+	// VERTEX -> TRIANGLE ADJACENCY
+	// Each vertex gathers its own faces, so no two threads write the same vertex
+	std::vector<GLuint> firstFace(vertexCount + 1, 0);
+	std::vector<GLuint> faces(triangleCount * 3);
+
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		firstFace[indices[i] + 1]++;
+
+	for (size_t v = 0; v < vertexCount; v++)
+		firstFace[v + 1] += firstFace[v];
+
+	std::vector<GLuint> cursor(firstFace.begin(), firstFace.end() - 1);
+
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		faces[cursor[indices[i]]++] = (GLuint)(i / 3);
+
+	// ---------------------------------------------------
+	// VERTEX TANGENTS
+	forBlocks(vertexCount, [&](size_t begin, size_t end)
+		{
+			for (size_t v = begin; v < end; v++)
+			{
+				glm::vec3 tangent(0.0f);
+				glm::vec3 bitangent(0.0f);
+
+				for (GLuint f = firstFace[v]; f < firstFace[v + 1]; f++)
+				{
+					tangent += faceTangents[faces[f]];
+					bitangent += faceBitangents[faces[f]];
+				}
+
+				GLfloat* out = vertices + v * layout.stride;
+				glm::vec3 normal = glm::make_vec3(out + layout.normalOffset);
+
+				if (glm::dot(normal, normal) > 0.0f)
+					normal = glm::normalize(normal);
+
+				// Gram-Schmidt against the normal
+				tangent -= normal * glm::dot(normal, tangent);
+
+				if (glm::dot(tangent, tangent) < 1e-20f)
+				{
+					// Any direction perpendicular to the normal
+					glm::vec3 axis = glm::abs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+					tangent = glm::cross(normal, axis);
+
+					if (glm::dot(tangent, tangent) < 1e-20f)
+						tangent = axis;
+				}
+
+				tangent = glm::normalize(tangent);
+				float handedness = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+
+				out[layout.tangentOffset] = tangent.x;
+				out[layout.tangentOffset + 1] = tangent.y;
+				out[layout.tangentOffset + 2] = tangent.z;
+				out[layout.tangentOffset + 3] = handedness;
+			}
+		});
+}
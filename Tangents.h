@@ -0,0 +1,24 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+
+// Where the generator reads and writes inside one interleaved vertex (in floats)
+struct TangentLayout
+{
+	int stride;
+	int normalOffset;
+	int uvOffset;
+	int tangentOffset; // xyz tangent + w handedness (bitangent = cross(N, T) * w)
+};
+
+/// <summary>
+/// Builds a smooth tangent frame for every unique vertex of an indexed mesh.
+/// Face tangents are accumulated per vertex, orthonormalized against the
+/// vertex normal (Gram-Schmidt), and the bitangent is reduced to a sign.
+/// Large meshes are split across the worker threads.
+/// </summary>
+void generateTangents(GLfloat* vertices,
+	size_t vertexCount,
+	const GLuint* indices,
+	size_t indexCount,
+	const TangentLayout& layout);
@@ -0,0 +1,183 @@
+#include "TextureArrays.h"
+#include "TextureStreaming.h"
+#include "TextureUploads.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	GLenum pixelFormatOf(int channels)
+	{
+		switch (channels)
+		{
+		case 1:
+			return GL_RED;
+		case 2:
+			return GL_RG;
+		case 3:
+			return GL_RGB;
+		default:
+			return GL_RGBA;
+		}
+	}
+}
+
+TextureArray::TextureArray(int layerCount, int width, int height, BlockFormat format) : layerCount(layerCount),
+	width(width),
+	height(height),
+	levels(1),
+	format(format),
+	layers(layerCount)
+{
+	while ((std::max(width, height) >> this->levels) > 0)
+		this->levels++;
+
+	this->finestLevel = this->levels;
+}
+
+std::shared_ptr<TextureArray> TextureArray::create(int layerCount, bool streamed, int width, int height, BlockFormat format)
+{
+	std::shared_ptr<TextureArray> array = std::make_shared<TextureArray>(layerCount, width, height, format);
+	std::shared_ptr<TextureAsset> texture = std::make_shared<TextureAsset>();
+
+	glGenTextures(1, &texture->id);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture->id);
+	array->texture = texture;
+
+	if (!streamed)
+	{
+		array->allocate();
+		array->finestLevel = 0;
+		TextureStreamer::add(array->texture, array, 0, "texture array");
+		return array;
+	}
+
+	// No layer is set yet, so this only allocates and picks the base level
+	array->finestLevel = TextureStreamer::uploadCoarse(*array);
+	TextureStreamer::add(array->texture, array, array->finestLevel, "texture array");
+
+	return array;
+}
+
+bool TextureArray::setLayer(int layer, ArrayLayer data)
+{
+	if (layer < 0 || layer >= this->layerCount)
+		return false;
+
+	BlockFormat format = data.cache ? data.cache->blockFormat() : data.format;
+
+	if ((data.cache || data.pixels) && !accepts(format))
+	{
+		std::cout << "Texture array layer " << layer << " is " << blockFormatName(format)
+			<< ", the array holds " << blockFormatName(this->format) << "\n";
+		return false;
+	}
+
+	this->layers[layer] = std::move(data);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, this->texture->id);
+
+	for (int level = this->levels - 1; level >= this->finestLevel; level--)
+		uploadLayerLevel(layer, level);
+
+	return true;
+}
+
+size_t TextureArray::levelBytes(int level) const
+{
+	int levelWidth = std::max(this->width >> level, 1);
+	int levelHeight = std::max(this->height >> level, 1);
+
+	if (this->format != BlockFormat::None)
+		return imageBytes(this->format, levelWidth, levelHeight, 0) * this->layerCount;
+
+	return (size_t)levelWidth * levelHeight * 4 * this->layerCount;
+}
+
+void TextureArray::allocate()
+{
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, this->levels - 1);
+
+	for (int level = 0; level < this->levels; level++)
+		allocateLevel(level);
+}
+
+void TextureArray::allocateLevel(int level)
+{
+	GLsizei levelWidth = std::max(this->width >> level, 1);
+	GLsizei levelHeight = std::max(this->height >> level, 1);
+
+	if (this->format != BlockFormat::None)
+	{
+		glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, compressedFormat(this->format), levelWidth, levelHeight,
+			this->layerCount, 0, (GLsizei)levelBytes(level), nullptr);
+		return;
+	}
+
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth, levelHeight, this->layerCount, 0,
+		GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+}
+
+void TextureArray::uploadLevel(int level)
+{
+	for (int layer = 0; layer < this->layerCount; layer++)
+		uploadLayerLevel(layer, level);
+
+	this->finestLevel = std::min(this->finestLevel, level);
+}
+
+void TextureArray::releaseLevel(int level)
+{
+	if (this->format != BlockFormat::None)
+		glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, compressedFormat(this->format), 0, 0, 0, 0, 0, nullptr);
+	else
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	// Layers set from now on skip the released level
+	this->finestLevel = std::max(this->finestLevel, level + 1);
+}
+
+void TextureArray::uploadLayerLevel(int layer, int level)
+{
+	const ArrayLayer& data = this->layers[layer];
+	GLsizei levelWidth = std::max(this->width >> level, 1);
+	GLsizei levelHeight = std::max(this->height >> level, 1);
+	int channels = data.channels;
+	GLenum format = pixelFormatOf(data.channels);
+	GLenum type = GL_UNSIGNED_BYTE;
+	const unsigned char* pixels = nullptr;
+
+	if (data.cache)
+	{
+		// Requests mapped from their cache are never decoded, only the header knows
+		channels = (int)data.cache->getHeader().channels;
+		format = data.cache->getHeader().pixelFormat;
+		type = data.cache->getHeader().pixelType;
+		pixels = data.cache->getLevel((uint32_t)level);
+	}
+	else if (level == 0)
+	{
+		pixels = data.pixels.get();
+	}
+	else if (level <= (int)data.levels.size())
+	{
+		pixels = data.levels[level - 1].pixels.data();
+	}
+
+	// Layers not set yet stay empty
+	if (pixels == nullptr)
+		return;
+
+	if (this->format != BlockFormat::None)
+	{
+		TextureUploader::compressedSubImage3D(GL_TEXTURE_2D_ARRAY, level, layer, levelWidth, levelHeight,
+			compressedFormat(this->format), pixels, imageBytes(this->format, levelWidth, levelHeight, 0));
+		return;
+	}
+
+	TextureUploader::subImage3D(GL_TEXTURE_2D_ARRAY, level, layer, levelWidth, levelHeight, format, type, pixels,
+		(size_t)levelWidth * levelHeight * channels);
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <glad/glad.h>
+
+#include "AssetRegistry.h"
+#include "BlockCompression.h"
+#include "Mipmaps.h"
+#include "MipSource.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Mip chain of one layer, either mapped from the image's texture cache
+// or decoded, at the array's size
+struct ArrayLayer
+{
+	std::shared_ptr<TextureCache> cache;
+	// Level 0 when there is no cache, levels holding the rest
+	std::shared_ptr<unsigned char> pixels;
+	std::vector<MipLevel> levels;
+	int channels = 0;
+	// Layout of pixels and levels, which must be the array's
+	BlockFormat format = BlockFormat::None;
+};
+
+/// <summary>
+/// One GL_TEXTURE_2D_ARRAY (RGBA8, or blocks of one BlockFormat) shared
+/// by a group of models, each drawing from its own layer, so the whole
+/// group goes out without texture binds.
+/// Every layer has the array's size (that of the images grouped in it)
+/// and full mip chain; with mip streaming the levels of all layers stream
+/// in (and out) together.
+/// Everything here runs on the GL thread.
+/// </summary>
+class TextureArray : public MipSource
+{
+private:
+	TextureHandle texture;
+	int layerCount;
+	int width, height;
+	int levels;
+	BlockFormat format;
+	// Finest level filled on every layer set so far (levels before the first upload)
+	int finestLevel;
+	// Kept for the whole run, so levels dropped over budget can come back
+	std::vector<ArrayLayer> layers;
+
+	// Allocates every level, leaving them empty
+	void allocate();
+	void uploadLayerLevel(int layer, int level);
+
+public:
+	TextureArray(int layerCount, int width, int height, BlockFormat format);
+
+	/// <summary>
+	/// Creates an array of empty width x height layers, bound on GL_TEXTURE0.
+	/// With streamed set only the levels up to MIP_STREAM_START_SIZE are
+	/// filled as layers come in, the texture streamer adding the finer ones
+	/// on request. Compressed arrays take layers in their own format only
+	/// (BC1 drops alpha).
+	/// </summary>
+	static std::shared_ptr<TextureArray> create(int layerCount, bool streamed, int width, int height,
+		BlockFormat format = BlockFormat::None);
+
+	// Whether layers in format can go in; anything else would be read as garbage
+	inline bool accepts(BlockFormat format) const
+	{
+		return format == this->format;
+	}
+
+	// Fills a layer with every level the array holds so far; data must have the
+	// array's size. Layers the array does not accept are refused, returning false.
+	bool setLayer(int layer, ArrayLayer data);
+
+	inline int getWidth() const
+	{
+		return this->width;
+	}
+
+	inline int getHeight() const
+	{
+		return this->height;
+	}
+
+	inline const TextureHandle& getTexture() const
+	{
+		return this->texture;
+	}
+
+	inline int getLayerCount() const
+	{
+		return this->layerCount;
+	}
+
+	inline BlockFormat blockFormat() const
+	{
+		return this->format;
+	}
+
+	// ---------------------------------------------------
+	// MIP SOURCE
+	inline GLenum target() const override
+	{
+		return GL_TEXTURE_2D_ARRAY;
+	}
+
+	inline int levelCount() const override
+	{
+		return this->levels;
+	}
+
+	inline int size() const override
+	{
+		return std::max(this->width, this->height);
+	}
+
+	size_t levelBytes(int level) const override;
+	void allocateLevel(int level) override;
+	void uploadLevel(int level) override;
+	void releaseLevel(int level) override;
+};
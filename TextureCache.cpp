@@ -0,0 +1,189 @@
+#include "TextureCache.h"
+#include "TextureUploads.h"
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace
+{
+	const uint64_t BLOB_ALIGNMENT = 16;
+
+	inline uint64_t alignUp(uint64_t value)
+	{
+		return (value + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+	}
+}
+
+bool TextureCache::open(const std::string& path, uint64_t sourceHash)
+{
+	close();
+
+	if (!this->file.open(path) || this->file.size() < sizeof(TextureCacheHeader))
+	{
+		this->file.close();
+		return false;
+	}
+
+	const TextureCacheHeader* candidate = (const TextureCacheHeader*)this->file.data();
+
+	bool valid = candidate->magic == TEXTURE_CACHE_MAGIC &&
+		candidate->version == TEXTURE_CACHE_VERSION &&
+		candidate->sourceHash == sourceHash &&
+		candidate->levelCount >= 1 &&
+		candidate->levelCount <= MAX_TEXTURE_LEVELS &&
+		candidate->blockFormat <= (uint32_t)BlockFormat::BC5;
+
+	for (uint32_t i = 0; valid && i < candidate->levelCount; i++)
+	{
+		const TextureLevel& level = candidate->levels[i];
+
+		valid = level.offset <= this->file.size() &&
+			level.size <= this->file.size() - level.offset &&
+			level.size == imageBytes((BlockFormat)candidate->blockFormat, (int)level.width, (int)level.height, (int)candidate->channels);
+	}
+
+	if (!valid)
+	{
+		this->file.close();
+		return false;
+	}
+
+	this->header = candidate;
+	return true;
+}
+
+void TextureCache::close()
+{
+	this->header = nullptr;
+	this->file.close();
+}
+
+void TextureCache::upload()
+{
+	allocate();
+
+	for (int i = 0; i < levelCount(); i++)
+		uploadLevel(i);
+}
+
+void TextureCache::allocate()
+{
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)this->header->levelCount - 1);
+
+	for (int i = 0; i < levelCount(); i++)
+		allocateLevel(i);
+}
+
+void TextureCache::allocateLevel(int level)
+{
+	const TextureLevel& entry = this->header->levels[level];
+
+	if (blockFormat() != BlockFormat::None)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, (GLenum)this->header->internalFormat,
+			(GLsizei)entry.width, (GLsizei)entry.height, 0, (GLsizei)entry.size, nullptr);
+		return;
+	}
+
+	glTexImage2D(GL_TEXTURE_2D, (GLint)level, this->header->internalFormat,
+		(GLsizei)entry.width, (GLsizei)entry.height, 0,
+		this->header->pixelFormat, this->header->pixelType, nullptr);
+}
+
+void TextureCache::releaseLevel(int level)
+{
+	if (blockFormat() != BlockFormat::None)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, (GLenum)this->header->internalFormat, 0, 0, 0, 0, nullptr);
+		return;
+	}
+
+	glTexImage2D(GL_TEXTURE_2D, (GLint)level, this->header->internalFormat, 0, 0, 0,
+		this->header->pixelFormat, this->header->pixelType, nullptr);
+}
+
+void TextureCache::uploadLevel(int level)
+{
+	const TextureLevel& entry = this->header->levels[level];
+
+	if (blockFormat() != BlockFormat::None)
+	{
+		TextureUploader::compressedSubImage2D(GL_TEXTURE_2D, (GLint)level,
+			(GLsizei)entry.width, (GLsizei)entry.height,
+			(GLenum)this->header->internalFormat, getLevel((uint32_t)level), (size_t)entry.size);
+		return;
+	}
+
+	TextureUploader::subImage2D(GL_TEXTURE_2D, (GLint)level,
+		(GLsizei)entry.width, (GLsizei)entry.height,
+		this->header->pixelFormat, this->header->pixelType, getLevel((uint32_t)level), (size_t)entry.size);
+}
+
+bool TextureCache::write(const std::string& path,
+	TextureCacheHeader header,
+	const unsigned char* basePixels,
+	const std::vector<MipLevel>& levels)
+{
+	if (levels.size() + 1 > MAX_TEXTURE_LEVELS)
+		return false;
+
+	header.magic = TEXTURE_CACHE_MAGIC;
+	header.version = TEXTURE_CACHE_VERSION;
+	header.levelCount = (uint32_t)levels.size() + 1;
+
+	std::vector<const unsigned char*> data(header.levelCount);
+	uint64_t offset = alignUp(sizeof(TextureCacheHeader));
+
+	for (uint32_t i = 0; i < header.levelCount; i++)
+	{
+		TextureLevel& level = header.levels[i];
+
+		level.width = i == 0 ? header.width : (uint32_t)levels[i - 1].width;
+		level.height = i == 0 ? header.height : (uint32_t)levels[i - 1].height;
+		level.size = imageBytes((BlockFormat)header.blockFormat, (int)level.width, (int)level.height, (int)header.channels);
+		level.offset = offset;
+		data[i] = i == 0 ? basePixels : levels[i - 1].pixels.data();
+
+		offset = alignUp(offset + level.size);
+	}
+
+	// Written aside and renamed over the cache, so a reader that has the
+	// old file mapped never sees it truncated or half written. The name is
+	// per thread, two writers of one cache each rename a whole file.
+	std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	std::error_code code;
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+
+		const char padding[BLOB_ALIGNMENT] = {};
+		uint64_t written = sizeof(header);
+
+		out.write((const char*)&header, sizeof(header));
+
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			out.write(padding, header.levels[i].offset - written);
+			out.write((const char*)data[i], header.levels[i].size);
+			written = header.levels[i].offset + header.levels[i].size;
+		}
+
+		if (!out)
+		{
+			out.close();
+			std::filesystem::remove(temporary, code);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temporary, path, code);
+
+	if (!code)
+		return true;
+
+	// Windows refuses to replace a file another process has mapped
+	std::filesystem::remove(temporary, code);
+	return false;
+}
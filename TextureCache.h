@@ -0,0 +1,132 @@
+#pragma once
+#include "BlockCompression.h"
+#include "MappedFile.h"
+#include "MipSource.h"
+#include "Mipmaps.h"
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const uint32_t TEXTURE_CACHE_MAGIC = 0x58545847; // "GXTX"
+// Bump whenever the decoder, the mip filter or this layout changes so old caches get rebuilt
+const uint32_t TEXTURE_CACHE_VERSION = 2;
+// Enough for a 32768 texel side
+const int MAX_TEXTURE_LEVELS = 16;
+
+// One mip level, stored as glTexSubImage2D takes it (rows packed to 1 byte),
+// or as glCompressedTexSubImage2D does for block-compressed textures
+struct TextureLevel
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+/// <summary>
+/// On-disk header of a predecoded texture (.tex): every mip level in its
+/// final GL format. sourceHash covers the image file and the load options.
+/// blockFormat is a BlockFormat, internalFormat its GL format when compressed.
+/// Layout: header | level 0 | level 1 | ..., blobs 16-byte aligned.
+/// </summary>
+struct TextureCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	int32_t internalFormat;
+	uint32_t pixelFormat;
+	uint32_t pixelType;
+
+	uint32_t levelCount;
+	uint32_t blockFormat;
+	TextureLevel levels[MAX_TEXTURE_LEVELS];
+};
+
+/// <summary>
+/// Memory-mapped view of a predecoded texture.
+/// Level pointers point straight into the mapping.
+/// </summary>
+class TextureCache : public MipSource
+{
+private:
+	MappedFile file;
+	const TextureCacheHeader* header;
+
+public:
+	inline TextureCache() : header(nullptr) {}
+
+	// Maps the cache, fails if it is missing, stale or malformed
+	bool open(const std::string& path, uint64_t sourceHash);
+	void close();
+
+	inline bool isOpen() const
+	{
+		return this->header != nullptr;
+	}
+
+	inline const TextureCacheHeader& getHeader() const
+	{
+		return *this->header;
+	}
+
+	inline const unsigned char* getLevel(uint32_t level) const
+	{
+		return this->file.data() + this->header->levels[level].offset;
+	}
+
+	// Allocates every level on the bound GL_TEXTURE_2D and fills it with glTexSubImage2D
+	void upload();
+	// Allocates every level on the bound GL_TEXTURE_2D, leaving them empty
+	void allocate();
+
+	// ---------------------------------------------------
+	// MIP SOURCE
+	inline GLenum target() const override
+	{
+		return GL_TEXTURE_2D;
+	}
+
+	inline int levelCount() const override
+	{
+		return (int)this->header->levelCount;
+	}
+
+	inline int size() const override
+	{
+		return (int)(this->header->width > this->header->height ? this->header->width : this->header->height);
+	}
+
+	inline BlockFormat blockFormat() const
+	{
+		return (BlockFormat)this->header->blockFormat;
+	}
+
+	inline size_t levelBytes(int level) const override
+	{
+		const TextureLevel& entry = this->header->levels[level];
+
+		// Blocks take on the GPU what they take on disk
+		if (blockFormat() != BlockFormat::None)
+			return (size_t)entry.size;
+
+		return (size_t)entry.width * entry.height * texelBytes(this->header->internalFormat);
+	}
+
+	void allocateLevel(int level) override;
+	void uploadLevel(int level) override;
+	void releaseLevel(int level) override;
+
+	// Writes a cache file from the base image and the levels below it (texels,
+	// or blocks of header.blockFormat); level sizes and offsets are filled in here
+	static bool write(const std::string& path,
+		TextureCacheHeader header,
+		const unsigned char* basePixels,
+		const std::vector<MipLevel>& levels);
+};
@@ -0,0 +1,291 @@
+#include "TextureStreaming.h"
+#include "TextureUploads.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+
+namespace
+{
+	struct StreamedTexture
+	{
+		std::weak_ptr<const TextureAsset> texture;
+		std::shared_ptr<MipSource> source;
+		std::string name;
+		int residentLevel; // finest level filled, and GL_TEXTURE_BASE_LEVEL
+		int wantedLevel;   // finest level asked for in the frame it was last seen
+		unsigned lastSeen; // frame of the last request
+	};
+
+	struct FixedTexture
+	{
+		std::weak_ptr<const TextureAsset> texture;
+		size_t bytes;
+		std::string name;
+	};
+
+	// Keyed by the asset, entries whose asset died are dropped by update()
+	std::unordered_map<const TextureAsset*, StreamedTexture> streamed;
+	std::unordered_map<const TextureAsset*, FixedTexture> fixed;
+
+	size_t budget = TEXTURE_BUDGET_BYTES;
+	// Requests made after the last update() belong to this frame
+	unsigned frame = 1;
+
+	// The entry of texture, null if it is not streamed (or its asset is gone)
+	StreamedTexture* find(const TextureHandle& texture)
+	{
+		auto found = streamed.find(texture.get());
+
+		if (found == streamed.end() || found->second.texture.lock() != texture)
+			return nullptr;
+
+		return &found->second;
+	}
+
+	size_t residentBytes(const StreamedTexture& entry)
+	{
+		size_t bytes = 0;
+
+		for (int level = entry.residentLevel; level < entry.source->levelCount(); level++)
+			bytes += entry.source->levelBytes(level);
+
+		return bytes;
+	}
+
+	void dropExpired()
+	{
+		for (auto it = streamed.begin(); it != streamed.end();)
+			it = it->second.texture.expired() ? streamed.erase(it) : std::next(it);
+
+		for (auto it = fixed.begin(); it != fixed.end();)
+			it = it->second.texture.expired() ? fixed.erase(it) : std::next(it);
+	}
+
+	/// <summary>
+	/// Releases the finest level of the texture seen least recently, among
+	/// those not seen since seenFrame. Returns the bytes freed, 0 when no
+	/// texture qualifies.
+	/// </summary>
+	size_t evictOne(unsigned seenFrame)
+	{
+		StreamedTexture* victim = nullptr;
+
+		for (auto& it : streamed)
+		{
+			StreamedTexture& entry = it.second;
+
+			if (entry.lastSeen >= seenFrame || entry.residentLevel >= entry.source->levelCount() - 1)
+				continue;
+
+			// Oldest first, then the one with the largest level to give back
+			if (victim == nullptr || entry.lastSeen < victim->lastSeen ||
+				(entry.lastSeen == victim->lastSeen &&
+					entry.source->levelBytes(entry.residentLevel) > victim->source->levelBytes(victim->residentLevel)))
+				victim = &entry;
+		}
+
+		if (victim == nullptr)
+			return 0;
+
+		TextureHandle texture = victim->texture.lock();
+		GLenum target = victim->source->target();
+		int level = victim->residentLevel;
+		size_t bytes = victim->source->levelBytes(level);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(target, texture->id);
+		glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, level + 1);
+		victim->source->releaseLevel(level);
+
+		// Not wanted back until it is seen again
+		victim->residentLevel = level + 1;
+		victim->wantedLevel = level + 1;
+
+		return bytes;
+	}
+}
+
+int TextureStreamer::uploadCoarse(MipSource& source)
+{
+	int level = source.levelCount() - 1;
+
+	glTexParameteri(source.target(), GL_TEXTURE_MAX_LEVEL, level);
+	source.allocateLevel(level);
+	source.uploadLevel(level);
+
+	while (level > 0 && std::max(source.size() >> (level - 1), 1) <= MIP_STREAM_START_SIZE)
+	{
+		source.allocateLevel(--level);
+		source.uploadLevel(level);
+	}
+
+	glTexParameteri(source.target(), GL_TEXTURE_BASE_LEVEL, level);
+	return level;
+}
+
+void TextureStreamer::add(const TextureHandle& texture, const std::shared_ptr<MipSource>& source, int residentLevel, const std::string& name)
+{
+	streamed[texture.get()] = {texture, source, name, residentLevel, residentLevel, frame};
+}
+
+void TextureStreamer::track(const TextureHandle& texture, size_t bytes, const std::string& name)
+{
+	fixed[texture.get()] = {texture, bytes, name};
+}
+
+void TextureStreamer::request(const TextureHandle& texture, float screenPixels)
+{
+	if (!texture)
+		return;
+
+	StreamedTexture* entry = find(texture);
+
+	if (entry == nullptr)
+		return;
+
+	float size = (float)entry->source->size();
+
+	// Level whose size matches the screen, then MIP_STREAM_BIAS finer
+	int level = screenPixels >= size ? 0 : (int)std::floor(std::log2(size / std::max(screenPixels, 1.0f))) - MIP_STREAM_BIAS;
+	level = std::max(level, 0);
+
+	// The finest level any draw asked for this frame
+	entry->wantedLevel = entry->lastSeen == frame ? std::min(entry->wantedLevel, level) : level;
+	entry->lastSeen = frame;
+}
+
+bool TextureStreamer::update(size_t maxBytes)
+{
+	dropExpired();
+
+	// Everything requested since the last update was seen in seenFrame
+	unsigned seenFrame = frame++;
+	size_t used = usedBytes();
+
+	// Over budget (lowered, or textures added), textures not seen lately give levels back
+	while (used > budget)
+	{
+		size_t freed = evictOne(seenFrame);
+
+		if (freed == 0)
+			break;
+
+		used -= freed;
+	}
+
+	size_t uploaded = 0;
+	bool first = true;
+
+	// Coarsest missing level over all textures seen last frame first, so
+	// every texture sharpens a step before any gets its largest level.
+	// Only textures out of sight are evicted, so next is never one of them.
+	while (true)
+	{
+		StreamedTexture* next = nullptr;
+
+		for (auto& it : streamed)
+		{
+			StreamedTexture& entry = it.second;
+
+			if (entry.lastSeen >= seenFrame && entry.wantedLevel < entry.residentLevel &&
+				(next == nullptr || entry.residentLevel > next->residentLevel))
+				next = &entry;
+		}
+
+		if (next == nullptr)
+			return false;
+
+		int level = next->residentLevel - 1;
+		size_t bytes = next->source->levelBytes(level);
+
+		if (!first && uploaded + bytes > maxBytes)
+			return true;
+
+		// Making room at the expense of textures out of sight, or waiting until some are
+		while (used + bytes > budget)
+		{
+			size_t freed = evictOne(seenFrame);
+
+			if (freed == 0)
+				return false;
+
+			used -= freed;
+		}
+
+		TextureHandle texture = next->texture.lock();
+		GLenum target = next->source->target();
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(target, texture->id);
+		next->source->allocateLevel(level);
+		next->source->uploadLevel(level);
+		glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, level);
+
+		next->residentLevel = level;
+		used += bytes;
+		uploaded += bytes;
+		first = false;
+	}
+}
+
+void TextureStreamer::setBudget(size_t bytes)
+{
+	budget = bytes;
+}
+
+bool TextureStreamer::fits(size_t bytes)
+{
+	return usedBytes() + bytes <= budget;
+}
+
+size_t TextureStreamer::usedBytes()
+{
+	size_t bytes = 0;
+
+	for (const auto& it : streamed)
+	{
+		if (!it.second.texture.expired())
+			bytes += residentBytes(it.second);
+	}
+
+	for (const auto& it : fixed)
+	{
+		if (!it.second.texture.expired())
+			bytes += it.second.bytes;
+	}
+
+	return bytes;
+}
+
+void TextureStreamer::report()
+{
+	dropExpired();
+
+	const double MB = 1024.0 * 1024.0;
+
+	std::printf("Texture memory: %.1f MB of %.1f MB budget\n", usedBytes() / MB, budget / MB);
+	std::printf("Uploaded: %.1f MB through the staging ring, %.1f MB direct\n",
+		TextureUploader::stagedBytes() / MB, TextureUploader::directBytes() / MB);
+	std::printf("%-48s %8s %12s %10s %10s\n", "texture", "level", "size", "MB", "last seen");
+
+	for (const auto& it : streamed)
+	{
+		const StreamedTexture& entry = it.second;
+		int side = std::max(entry.source->size() >> entry.residentLevel, 1);
+		std::string resident = std::to_string(entry.residentLevel) + "/" + std::to_string(entry.source->levelCount() - 1);
+
+		std::printf("%-48s %8s %12d %10.2f %10u\n", entry.name.c_str(), resident.c_str(), side,
+			residentBytes(entry) / MB, frame - 1 - std::min(entry.lastSeen, frame - 1));
+	}
+
+	for (const auto& it : fixed)
+		std::printf("%-48s %8s %12s %10.2f %10s\n", it.second.name.c_str(), "fixed", "", it.second.bytes / MB, "");
+}
+
+void TextureStreamer::clear()
+{
+	streamed.clear();
+	fixed.clear();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "AssetRegistry.h"
+#include "MipSource.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Levels up to this size (texels on the longer side) are uploaded with the texture
+const int MIP_STREAM_START_SIZE = 128;
+// Texel data streamed in per frame; at least one level goes in every frame regardless
+const size_t MIP_STREAM_BYTES_PER_FRAME = 4 << 20;
+// Levels finer than the screen size strictly needs, since UV charts only
+// cover part of the texture each
+const int MIP_STREAM_BIAS = 1;
+// Estimated GPU memory all tracked textures may use, unless set otherwise
+const size_t TEXTURE_BUDGET_BYTES = (size_t)256 << 20;
+
+/// <summary>
+/// Keeps the mip levels of cached textures (and texture arrays) resident
+/// by on-screen size within a texture memory budget. Textures start with
+/// only some levels allocated and filled, GL_TEXTURE_BASE_LEVEL keeping
+/// sampling off the rest. Finer levels stream in as objects get big enough
+/// on screen to need them. Over budget, the finest levels of the textures
+/// seen least recently are released again (and stream back in once they
+/// are needed). Textures without a cache are counted but never touched.
+/// Everything here runs on the GL thread.
+/// </summary>
+class TextureStreamer
+{
+public:
+	/// <summary>
+	/// Allocates and fills the levels up to MIP_STREAM_START_SIZE of the
+	/// texture bound to the source's target. Returns the finest level filled.
+	/// </summary>
+	static int uploadCoarse(MipSource& source);
+
+	// Tracks a texture uploaded down to residentLevel, keeping its source alive for the other levels
+	static void add(const TextureHandle& texture, const std::shared_ptr<MipSource>& source, int residentLevel, const std::string& name);
+
+	// Counts a texture the streamer cannot reload towards the budget
+	static void track(const TextureHandle& texture, size_t bytes, const std::string& name);
+
+	// Asks for the levels a texture needs this frame, when it spans screenPixels on screen
+	static void request(const TextureHandle& texture, float screenPixels);
+
+	/// <summary>
+	/// Brings usage back under budget, then uploads requested levels,
+	/// coarsest first, up to maxBytes (and at least one level). Returns
+	/// true while requested levels that fit the budget are still missing.
+	/// </summary>
+	static bool update(size_t maxBytes = MIP_STREAM_BYTES_PER_FRAME);
+
+	static void setBudget(size_t bytes);
+
+	// True when bytes more would still fit the budget
+	static bool fits(size_t bytes);
+
+	// Estimated GPU memory of every tracked texture
+	static size_t usedBytes();
+
+	// Prints the usage against the budget and the resident levels of every texture
+	static void report();
+
+	// Stops tracking everything. Texture arrays own their GL texture through
+	// the streamer, so this must run before the context goes.
+	static void clear();
+};
@@ -0,0 +1,257 @@
+#include "TextureUploads.h"
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+
+namespace
+{
+	// Start of every staged upload, for the driver's copy engines
+	const size_t STAGING_ALIGNMENT = 256;
+
+	struct FrameFence
+	{
+		GLsync sync;
+		size_t bytes; // ring bytes the frame filled, skipped ones included
+	};
+
+	GLuint buffer = 0;
+	size_t capacity = 0;
+	// Mapping of the whole ring, null when each upload maps its own range
+	unsigned char* mapped = nullptr;
+
+	// The ring is used from head on: the frames still in flight hold the
+	// inFlight bytes behind the unfenced ones of the current frame
+	size_t head = 0;
+	size_t inFlight = 0;
+	size_t pending = 0;
+	std::deque<FrameFence> fences;
+
+	size_t staged = 0;
+	size_t direct = 0;
+
+	// Frees the ranges of every frame the GPU is done with, without waiting
+	void retire()
+	{
+		while (!fences.empty())
+		{
+			GLenum status = glClientWaitSync(fences.front().sync, 0, 0);
+
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				break;
+
+			glDeleteSync(fences.front().sync);
+			inFlight -= fences.front().bytes;
+			fences.pop_front();
+		}
+
+		if (inFlight == 0 && pending == 0)
+			head = 0;
+	}
+
+	/// <summary>
+	/// Copies bytes into the ring and gives their offset in the buffer.
+	/// False when the ring is missing, too small or still busy.
+	/// </summary>
+	bool stage(const void* pixels, size_t bytes, size_t& offset)
+	{
+		if (buffer == 0 || bytes > capacity)
+			return false;
+
+		retire();
+
+		size_t start = (head + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+
+		// Not enough left before the end, the upload starts over at 0
+		if (start + bytes > capacity)
+			start = 0;
+
+		size_t skipped = start >= head ? start - head : capacity - head;
+
+		if (inFlight + pending + skipped + bytes > capacity)
+			return false;
+
+		if (mapped)
+		{
+			std::memcpy(mapped + start, pixels, bytes);
+		}
+		else
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			void* range = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, (GLintptr)start, (GLsizeiptr)bytes,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+			if (range)
+			{
+				std::memcpy(range, pixels, bytes);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			}
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+			if (range == nullptr)
+				return false;
+		}
+
+		head = start + bytes;
+		pending += skipped + bytes;
+		offset = start;
+
+		return true;
+	}
+
+	/// <summary>
+	/// Runs upload with the staged copy of the data (an offset into the
+	/// bound ring) or, when the ring has no room, with the data itself.
+	/// </summary>
+	void send(const void* data, size_t bytes, const std::function<void(const void*)>& upload)
+	{
+		size_t offset = 0;
+
+		// Levels are tightly packed, RGB rows are not 4-byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		if (stage(data, bytes, offset))
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			upload((const void*)(uintptr_t)offset);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			staged += bytes;
+		}
+		else
+		{
+			upload(data);
+			direct += bytes;
+		}
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+}
+
+void TextureUploader::init(size_t bytes)
+{
+	shutdown();
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+
+	if (GLAD_GL_VERSION_4_4)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)bytes, nullptr, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)bytes, flags);
+	}
+	else
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)bytes, nullptr, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	capacity = bytes;
+}
+
+void TextureUploader::shutdown()
+{
+	for (FrameFence& fence : fences)
+		glDeleteSync(fence.sync);
+
+	fences.clear();
+
+	if (mapped)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	if (buffer != 0)
+		glDeleteBuffers(1, &buffer);
+
+	buffer = 0;
+	capacity = 0;
+	mapped = nullptr;
+	head = inFlight = pending = 0;
+}
+
+void TextureUploader::subImage2D(GLenum target, GLint level, GLsizei width, GLsizei height,
+	GLenum format, GLenum type, const void* pixels, size_t bytes)
+{
+	send(pixels, bytes, [&](const void* source)
+		{ glTexSubImage2D(target, level, 0, 0, width, height, format, type, source); });
+}
+
+void TextureUploader::subImage3D(GLenum target, GLint level, GLint layer, GLsizei width, GLsizei height,
+	GLenum format, GLenum type, const void* pixels, size_t bytes)
+{
+	send(pixels, bytes, [&](const void* source)
+		{ glTexSubImage3D(target, level, 0, 0, layer, width, height, 1, format, type, source); });
+}
+
+void TextureUploader::compressedSubImage2D(GLenum target, GLint level, GLsizei width, GLsizei height,
+	GLenum internalFormat, const void* blocks, size_t bytes)
+{
+	send(blocks, bytes, [&](const void* source)
+		{ glCompressedTexSubImage2D(target, level, 0, 0, width, height, internalFormat, (GLsizei)bytes, source); });
+}
+
+void TextureUploader::compressedSubImage3D(GLenum target, GLint level, GLint layer, GLsizei width, GLsizei height,
+	GLenum internalFormat, const void* blocks, size_t bytes)
+{
+	send(blocks, bytes, [&](const void* source)
+		{ glCompressedTexSubImage3D(target, level, 0, 0, layer, width, height, 1, internalFormat, (GLsizei)bytes, source); });
+}
+
+void TextureUploader::endFrame()
+{
+	if (pending == 0)
+		return;
+
+	fences.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), pending});
+	inFlight += pending;
+	pending = 0;
+}
+
+void TextureUploader::allocate(GLenum target, GLsizei levels, GLint internalFormat, GLsizei width, GLsizei height,
+	GLenum format, GLenum type)
+{
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+	if (GLAD_GL_VERSION_4_2)
+	{
+		glTexStorage2D(target, levels, sizedFormat(internalFormat), width, height);
+		return;
+	}
+
+	GLenum first = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+	GLenum faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+	BlockFormat blocks = blockFormatOf(internalFormat);
+
+	for (GLsizei level = 0; level < levels; level++)
+	{
+		GLsizei levelWidth = std::max(width >> level, 1);
+		GLsizei levelHeight = std::max(height >> level, 1);
+
+		for (GLenum face = 0; face < faces; face++)
+		{
+			if (blocks != BlockFormat::None)
+				glCompressedTexImage2D(first + face, level, (GLenum)internalFormat, levelWidth, levelHeight, 0,
+					(GLsizei)imageBytes(blocks, levelWidth, levelHeight, 0), nullptr);
+			else
+				glTexImage2D(first + face, level, internalFormat, levelWidth, levelHeight, 0, format, type, nullptr);
+		}
+	}
+}
+
+size_t TextureUploader::stagedBytes()
+{
+	return staged;
+}
+
+size_t TextureUploader::directBytes()
+{
+	return direct;
+}
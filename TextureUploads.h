@@ -0,0 +1,80 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Staging memory for texel uploads: a full 2048x2048 RGBA level twice over
+const size_t UPLOAD_RING_BYTES = (size_t)32 << 20;
+
+/// <summary>
+/// Sends texel data to textures through a ring of pixel unpack buffer
+/// memory, so glTexSubImage2D returns as soon as the texels are copied into
+/// it and the driver transfers them while the frame goes on. On GL 4.4 the
+/// ring is persistently mapped once, before that each upload maps its range
+/// unsynchronized. The ring's ranges are reused once the fence of the frame
+/// that filled them has passed; the ring never waits on one, uploads that
+/// find it full go straight from client memory instead.
+/// Everything here runs on the GL thread.
+/// </summary>
+class TextureUploader
+{
+public:
+	// Creates the ring, once the context is current. Without it every upload is direct.
+	static void init(size_t bytes = UPLOAD_RING_BYTES);
+	// Frees the ring, while the context still exists
+	static void shutdown();
+
+	/// <summary>
+	/// glTexSubImage2D of a whole level (or cube face) of the bound texture
+	/// from tightly packed rows; bytes is the size of pixels.
+	/// </summary>
+	static void subImage2D(GLenum target, GLint level, GLsizei width, GLsizei height,
+		GLenum format, GLenum type, const void* pixels, size_t bytes);
+
+	// The same for one layer of a level of the bound texture array
+	static void subImage3D(GLenum target, GLint level, GLint layer, GLsizei width, GLsizei height,
+		GLenum format, GLenum type, const void* pixels, size_t bytes);
+
+	// glCompressedTexSubImage2D of a whole level (or cube face) from its blocks
+	static void compressedSubImage2D(GLenum target, GLint level, GLsizei width, GLsizei height,
+		GLenum internalFormat, const void* blocks, size_t bytes);
+
+	// The same for one layer of a level of the bound texture array
+	static void compressedSubImage3D(GLenum target, GLint level, GLint layer, GLsizei width, GLsizei height,
+		GLenum internalFormat, const void* blocks, size_t bytes);
+
+	// Fences the uploads made since the last call, once a frame before the buffer swap
+	static void endFrame();
+
+	/// <summary>
+	/// Gives the bound GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP all its levels at
+	/// once: immutable storage on GL 4.2, one glTexImage2D (or
+	/// glCompressedTexImage2D) per level and face before that. Only for
+	/// textures that keep every level, the streamer respecifies the levels
+	/// it releases.
+	/// </summary>
+	static void allocate(GLenum target, GLsizei levels, GLint internalFormat, GLsizei width, GLsizei height,
+		GLenum format, GLenum type);
+
+	// Bytes sent through the ring and straight from client memory so far
+	static size_t stagedBytes();
+	static size_t directBytes();
+};
+
+// Sized form of an unsized internal format, as glTexStorage2D needs
+inline GLenum sizedFormat(GLint internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_RED:
+		return GL_R8;
+	case GL_RG:
+		return GL_RG8;
+	case GL_RGB:
+		return GL_RGB8;
+	case GL_RGBA:
+		return GL_RGBA8;
+	default:
+		return (GLenum)internalFormat;
+	}
+}
@@ -8,10 +8,21 @@
 
 #include "stb_image.h"
 #include "ShaderClass.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <future>
 #include <iostream>
 #include "Misc.h"
 
 #include "TDCam.h"
+#include "TextureArrays.h"
+#include "TextureStreaming.h"
+#include "TextureUploads.h"
+#include "AssetPack.h"
+#include "CubemapCache.h"
+#include "Benchmarks.h"
+#include "Profiler.h"
 
 //#include "main.h"
 using namespace std;
@@ -33,6 +44,23 @@ using namespace std;
 // -------------------------------------------------------
 // GLOBAL VARIABLES
 
+// Packed assets, looked up before the loose files
+const char *ASSET_PACK_PATH = "assets.pack";
+
+// Skybox faces in GL order (+X, -X, +Y, -Y, +Z, -Z), and all of them baked with their mip levels
+const std::vector<std::string> SKYBOX_FACES = {
+	"Skybox/uw_rt.jpg", // RIGHT
+	"Skybox/uw_lf.jpg", // LEFT
+	"Skybox/uw_up.jpg", // UP
+	"Skybox/uw_dn.jpg", // DOWN
+	"Skybox/uw_bk.jpg", // BACK
+	"Skybox/uw_ft.jpg", // FRONT
+};
+const char *SKYBOX_BAKE_PATH = "Skybox/uw.cube";
+
+// Skybox level drawn in the FPS filter mode, which hides the detail anyway (0 keeps full resolution)
+const int SKYBOX_FILTER_LEVEL = 1;
+
 // Screen width and height
 const float SCREEN_WIDTH = 1000.0f;
 const float SCREEN_HEIGHT = 1000.0f;
@@ -105,6 +133,10 @@ void Key_Callback(GLFWwindow *window, int key, int scancode, int action, int mod
 		}
 	}
 
+	// Prints texture memory use against the budget
+	if (key == GLFW_KEY_M && action == GLFW_PRESS)
+		TextureStreamer::report();
+
 	// Handling exit keys
 	if (key == GLFW_KEY_ESCAPE ||
 		key == GLFW_KEY_ENTER)
@@ -172,8 +204,121 @@ void Mouse_Callback(GLFWwindow *window, double xpos, double ypos)
 	handler->cam->setCameraPos(handler->cam->getCameraCenter() - handler->cam->getForward());
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
+	// Benchmark mode, runs without opening a window
+	if (argc > 1 && std::string(argv[1]) == "--bench-obj")
+	{
+		std::vector<std::string> paths(argv + 2, argv + argc);
+
+		if (paths.empty())
+			paths = {
+				"3D/cube_alt/cube.obj",
+				"3D/pun/solar.obj",
+				"3D/submarine/submarine.obj",
+				"3D/enemy_submarine/enemy_sub_1.obj",
+				"3D/enemy_submarine/enemy_sub_2.obj",
+				"3D/enemy_submarine/enemy_sub_3.obj",
+				"3D/enemy_submarine/enemy_sub_6.obj"};
+
+		benchmarkObjParsers(paths);
+		return 0;
+	}
+
+	// Mipmap benchmark, in a hidden window
+	if (argc > 1 && std::string(argv[1]) == "--bench-mips")
+	{
+		std::vector<std::string> paths(argv + 2, argv + argc);
+
+		if (paths.empty())
+			paths = {
+				"3D/submarine/submarine_submarine_BaseColor.png",
+				"3D/enemy_submarine/enemy_sub_1.png",
+				"3D/enemy_submarine/enemy_sub_3.png"};
+
+		benchmarkMipmaps(paths);
+		return 0;
+	}
+
+	// Block compression benchmark, in a hidden window
+	if (argc > 1 && std::string(argv[1]) == "--bench-compression")
+	{
+		std::vector<std::string> paths(argv + 2, argv + argc);
+
+		if (paths.empty())
+			paths = {
+				"3D/submarine/submarine_submarine_BaseColor.png",
+				"3D/enemy_submarine/enemy_sub_1.png",
+				"3D/enemy_submarine/enemy_sub_3.png"};
+
+		benchmarkCompression(paths);
+		return 0;
+	}
+
+	// Packing mode: GRAPHIX_MP --build-pack [--compress] [files or folders...]
+	if (argc > 1 && std::string(argv[1]) == "--build-pack")
+	{
+		std::vector<std::string> inputs(argv + 2, argv + argc);
+		bool compress = !inputs.empty() && inputs[0] == "--compress";
+
+		if (compress)
+			inputs.erase(inputs.begin());
+
+		if (inputs.empty())
+			inputs = {"3D", "Skybox", "Shaders"};
+
+		std::string error;
+
+		if (!AssetPack::build(ASSET_PACK_PATH, inputs, compress, error))
+		{
+			cout << "Could not build " << ASSET_PACK_PATH << ": " << error << "\n";
+			return 1;
+		}
+
+		return 0;
+	}
+
+	// Baking mode: GRAPHIX_MP --bake-skybox, after changing the skybox faces
+	if (argc > 1 && std::string(argv[1]) == "--bake-skybox")
+	{
+		std::vector<unsigned char> baked;
+		std::string error;
+
+		if (!CubemapCache::bake(SKYBOX_FACES, baked, error))
+		{
+			cout << "Could not bake " << SKYBOX_BAKE_PATH << ": " << error << "\n";
+			return 1;
+		}
+
+		if (!CubemapCache::write(SKYBOX_BAKE_PATH, baked))
+		{
+			cout << "Could not write " << SKYBOX_BAKE_PATH << "\n";
+			return 1;
+		}
+
+		return 0;
+	}
+
+	// Texture memory budget in MB: GRAPHIX_MP --texture-budget 128
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (std::string(argv[i]) == "--texture-budget")
+			TextureStreamer::setBudget((size_t)std::max(std::atoi(argv[i + 1]), 1) << 20);
+	}
+
+	// Textures stay uncompressed with GRAPHIX_MP --no-texture-compression
+	bool textureCompression = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--no-texture-compression")
+			textureCompression = false;
+	}
+
+	// Assets come from the pack when one is present, loose files fill in the rest
+	if (AssetPack::mount(ASSET_PACK_PATH))
+		cout << "Using " << ASSET_PACK_PATH << " (" << AssetPack::entryCount() << " assets)\n";
+
 	enum filter {
 		ON = 1, OFF = 0
 	};
@@ -210,7 +355,6 @@ int main(void)
 							glm::vec3(0.0f, THETA0, 0.0f),
 							0.15f
 						);
-	playerSub.loadObj();
 	EnemyClass enemySub1("3D/enemy_submarine/enemy_sub_1.obj",
 						 glm::vec3(0.0f, -5.0f, -10.0f),
 						 glm::vec3(20.0f, 5.0f, 6.0f),
@@ -236,12 +380,32 @@ int main(void)
 						 glm::vec3(9.0f, 0.0f, 10.0f),
 						 1.0f);
 
-	enemySub1.loadObj();
-	enemySub2.loadObj();
-	enemySub3.loadObj();
-	enemySub4.loadObj();
-	enemySub5.loadObj();
-	enemySub6.loadObj();
+	std::vector<ModelClass*> models{
+		&playerSub,
+		&enemySub1,
+		&enemySub2,
+		&enemySub3,
+		&enemySub4,
+		&enemySub5,
+		&enemySub6};
+
+	// Triangle clusters ordered to cut overdraw and culled per frame,
+	// and no CPU copy of the meshes once they are on the GPU
+	for (ModelClass* model : models)
+	{
+		model->useOverdrawOrdering(true);
+		model->useMeshletCulling(true);
+		model->useReleaseAfterUpload(true);
+	}
+
+	// Enemies sharpen their textures as they come closer, the player is always close
+	for (ModelClass* model : models)
+		model->useMipStreaming(model != &playerSub);
+
+	// Quantized vertices for the enemies, less than half the VRAM and vertex
+	// bandwidth; the player is seen up close, where half-float UVs can show
+	for (ModelClass* model : models)
+		model->usePackedVertices(model != &playerSub);
 
 	// -------------------------------------------------------
 	// SETTING SKYBOX VERTICES AND INDICES
@@ -288,6 +452,15 @@ int main(void)
 	// Initialize GLAD
 	gladLoadGL();
 
+	// Texel uploads go through a staging ring from here on
+	TextureUploader::init();
+
+	// Textures are cached and uploaded as BC1/BC3/BC5 blocks when the GPU samples them
+	textureCompression = textureCompression && blockCompressionSupported();
+
+	for (ModelClass* model : models)
+		model->useTextureCompression(textureCompression);
+
 	// Setting up input reading:
 	// - for keyboard inputs
 	glfwSetKeyCallback(window, Key_Callback);
@@ -307,8 +480,27 @@ int main(void)
 	enemySub5.attachTexture("3D/enemy_submarine/enemy_sub_5.png", GL_RGBA);
 	enemySub6.attachTexture("3D/enemy_submarine/enemy_sub_6.jpg", GL_RGB);
 
+	// -------------------------------------------------------
+	// ENEMY TEXTURE ARRAYS
+
+	// Enemies whose textures have the same size draw from one texture array,
+	// a layer each, so the group goes out without binding a texture in
+	// between. With compression on the layers are BC1 blocks, or BC3 when
+	// one of them uses its alpha.
+	std::vector<EnemyClass*> enemies = {&enemySub1, &enemySub2, &enemySub3, &enemySub4, &enemySub5, &enemySub6};
+	std::vector<std::shared_ptr<TextureArray>> enemyTextures = ModelClass::shareTextureArrays(
+		std::vector<ModelClass*>(enemies.begin(), enemies.end()), true, textureCompression);
+
 	playerSub.attachNormalTexture("3D/submarine/submarine_submarine_Normal.png", GL_RGB);
-	
+
+	// Per-material textures for models whose .mtl names any
+	for (ModelClass* model : models)
+		model->attachMaterialTextures(GL_RGBA);
+
+	// Parsing every model and decoding its textures in the background, the
+	// render loop starts right away and swaps them in as they finish
+	std::future<void> modelStreaming = ModelClass::streamAll(models);
+
 	// Enable depth test
 	glEnable(GL_DEPTH_TEST);
 	
@@ -326,71 +518,73 @@ int main(void)
 	// -------------------------------------------------------
 	// LOADING SKYBOX TEXTURES
 
-	std::string facesSkybox[]{
-		"Skybox/uw_rt.jpg", // RIGHT
-		"Skybox/uw_lf.jpg", // LEFT
-		"Skybox/uw_up.jpg", // UP
-		"Skybox/uw_dn.jpg", // DOWN
-		"Skybox/uw_bk.jpg", // BACK
-		"Skybox/uw_ft.jpg", // FRONT
-	};
+	// Read from its bake in the background like the models, uploaded by the render loop.
+	// Without a bake yet, or with one made from other faces, the faces are
+	// decoded once and baked for the next start.
+	std::future<std::shared_ptr<CubemapCache>> skyboxLoading = std::async(std::launch::async, []()
+		{
+			std::shared_ptr<CubemapCache> cubemap = std::make_shared<CubemapCache>();
+
+			{
+				PhaseTimer timer(SKYBOX_BAKE_PATH, "read");
+				uint64_t sourceHash = CubemapCache::hashFaces(SKYBOX_FACES);
+
+				if (sourceHash != 0 && cubemap->open(SKYBOX_BAKE_PATH, sourceHash))
+					return cubemap;
+			}
+
+			std::vector<unsigned char> baked;
+			std::string error;
+
+			if (!CubemapCache::bake(SKYBOX_FACES, baked, error))
+			{
+				cout << "Could not bake " << SKYBOX_BAKE_PATH << ": " << error << "\n";
+				return cubemap;
+			}
+
+			// A failed write only costs the decodes again next start
+			CubemapCache::write(SKYBOX_BAKE_PATH, baked);
+			cubemap->open(std::move(baked));
+
+			return cubemap;
+		});
 
-	unsigned int skyboxTex;
+	std::shared_ptr<TextureAsset> skybox = std::make_shared<TextureAsset>();
+	bool skyboxReady = false;
+	filter skyboxState = OFF;
 
-	glGenTextures(1, &skyboxTex);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
+	glGenTextures(1, &skybox->id);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, skybox->id);
 
-	// Prevent pixelating
+	// Prevent pixelating, mip levels keep the distant texels from shimmering
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
 	// Prevents tiling
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-	for (unsigned int i = 0; i < 6; i++)
-	{
-		int w, h, skyCChannel;
-		stbi_set_flip_vertically_on_load(false);
+	// Faces are filtered separately, seamless sampling hides their edges on the coarse levels
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-		unsigned char *data = stbi_load(
-			facesSkybox[i].c_str(),
-			&w,
-			&h,
-			&skyCChannel,
-			0);
+	auto uploadSkybox = [&]()
+	{
+		std::shared_ptr<CubemapCache> cubemap = skyboxLoading.get();
 
-		if (data)
+		if (cubemap->isOpen())
 		{
-			glTexImage2D(
-				GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-				0,
-				GL_RGB,
-				w,
-				h,
-				0,
-				GL_RGB,
-				GL_UNSIGNED_BYTE,
-				data);
-		}
-
-		stbi_image_free(data);
-	}
-
-	stbi_set_flip_vertically_on_load(true);
+			// Over the texture budget the skybox starts one level down
+			int firstLevel = TextureStreamer::fits(cubemap->textureBytes()) ? 0 : 1;
 
-	// -------------------------------------------------------
-	// CREATING OBJECT VAOs and VBOs
-
-	playerSub.createVAO_VBO();
+			PhaseTimer timer(SKYBOX_BAKE_PATH, "upload");
+			glBindTexture(GL_TEXTURE_CUBE_MAP, skybox->id);
+			cubemap->upload(firstLevel);
+			TextureStreamer::track(skybox, cubemap->textureBytes(firstLevel), SKYBOX_BAKE_PATH);
+		}
 
-	enemySub1.createVAO_VBO();
-	enemySub3.createVAO_VBO();
-	enemySub2.createVAO_VBO();
-	enemySub4.createVAO_VBO();
-	enemySub5.createVAO_VBO();
-	enemySub6.createVAO_VBO();
+		skyboxReady = true;
+	};
 
 	// -------------------------------------------------------
 	// CREATING SKYBOX VAO, VBO, and EBO
@@ -475,6 +669,10 @@ int main(void)
 		obj_shaderProgram.findUloc("pt_amb_col"),
 		obj_shaderProgram.findUloc("pt_color"),
 		obj_shaderProgram.findUloc("pt_src")};
+	// Fixed texture units: base texture, normal map and the enemies' texture array
+	glUniform1i(obj_shaderProgram.findUloc("tex0"), 0);
+	glUniform1i(obj_shaderProgram.findUloc("norm_tex"), 1);
+	glUniform1i(obj_shaderProgram.findUloc("texArray"), 2);
 	// getting uniforms for if object has normals
 	GLint hasBmp = obj_shaderProgram.findUloc("hasBmp");
 	// uniform location for camera position
@@ -516,12 +714,33 @@ int main(void)
 	glEnable(GL_CULL_FACE);
 	float deg = 90 - playerSub.playerRot.y;
 	glm::vec3 initial = playerSub.playerPos;
+	bool startupReported = false;
 	while (!glfwWindowShouldClose(window))
 	{
 		// gets the vector to move camera
 
 		// moves camera
 
+		// Swapping in whatever finished loading since the last frame,
+		// and the texture levels last frame's draws asked for
+		bool streaming = !ModelClass::uploadReady(models);
+		streaming = TextureStreamer::update() || streaming;
+
+		if (!skyboxReady)
+		{
+			if (skyboxLoading.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+				uploadSkybox();
+			else
+				streaming = true;
+		}
+
+		// Everything is on the GPU, timing breakdown of how it got there
+		if (!streaming && !startupReported)
+		{
+			StartupProfiler::report("startup_profile.json");
+			startupReported = true;
+		}
+
 		/* Render here */
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -597,9 +816,17 @@ int main(void)
 		glUniformMatrix4fv(skybox_viewLoc, 1, GL_FALSE, glm::value_ptr(skybox_view));
 
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox->id);
 
-		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+		// Switching levels only when the filter mode changes
+		if (skyboxReady && state != skyboxState)
+		{
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, state == ON ? SKYBOX_FILTER_LEVEL : 0);
+			skyboxState = state;
+		}
+
+		if (skyboxReady)
+			glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 
 		glDepthMask(GL_TRUE);
 		glDepthFunc(GL_LESS);
@@ -617,12 +844,27 @@ int main(void)
 
 		glUniform1i(hasBmp, GL_FALSE);
 
-		enemySub1.draw(obj_shaderProgram.getShader());
-		enemySub3.draw(obj_shaderProgram.getShader());
-		enemySub2.draw(obj_shaderProgram.getShader());
-		enemySub4.draw(obj_shaderProgram.getShader());
-		enemySub5.draw(obj_shaderProgram.getShader());
-		enemySub6.draw(obj_shaderProgram.getShader());
+		// The enemies size their detail levels against it
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		float viewportHeight = (float)viewport[3];
+
+		// Each array is bound once for its whole group, every enemy in it
+		// only picks its layer; the enemies without one come last
+		for (const std::shared_ptr<TextureArray>& array : enemyTextures)
+		{
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, array->getTexture()->id);
+			glActiveTexture(GL_TEXTURE0);
+
+			for (EnemyClass* enemy : enemies)
+				if (enemy->getTextureArray() == array)
+					enemy->draw(obj_shaderProgram.getShader(), projectionMatrix, viewMatrix, viewportHeight);
+		}
+
+		for (EnemyClass* enemy : enemies)
+			if (!enemy->getTextureArray())
+				enemy->draw(obj_shaderProgram.getShader(), projectionMatrix, viewMatrix, viewportHeight);
 
 		// -----------------------------------------------------------------
 		// MISC
@@ -638,18 +880,36 @@ int main(void)
 		}
 		glCullFace(GL_FRONT);
 
+		// The staging ring reuses this frame's uploads once the GPU is past them
+		TextureUploader::endFrame();
+
 		/* Swap front and back buffers */
 		glfwSwapBuffers(window);
 
-		/* Poll for and process events */
-		glfwWaitEventsTimeout(3);
+		/* Poll for and process events, redrawing often while assets stream in */
+		glfwWaitEventsTimeout(streaming ? 1.0 / 60.0 : 3.0);
 	}
 
-	// Cleanup
+	// Cleanup, while the context still exists
+	modelStreaming.wait();
+
+	// Already taken by uploadSkybox once the skybox has loaded
+	if (skyboxLoading.valid())
+		skyboxLoading.wait();
+
+	for (ModelClass* model : models)
+		model->releaseResources();
+
+	enemyTextures.clear();
+	skybox.reset();
+	TextureStreamer::clear();
+	TextureUploader::shutdown();
+
 	glDeleteVertexArrays(1, &skyboxVAO);
 	glDeleteBuffers(1, &skyboxVBO);
 	glDeleteBuffers(1, &skyboxEBO);
 
+	AssetPack::unmount();
 	glfwTerminate();
 	return 0;
 }
\ No newline at end of file